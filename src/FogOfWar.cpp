@@ -0,0 +1,167 @@
+#include "FogOfWar.h"
+
+using namespace std;
+
+void FogOfWar::setup(fp_t width, fp_t height)
+{
+  nx = std::max(1, static_cast<int>(std::ceil(width / TILE_SIZE)));
+  ny = std::max(1, static_cast<int>(std::ceil(height / TILE_SIZE)));
+  clear();
+}
+
+void FogOfWar::clear()
+{
+  for (auto &c : counts) {
+    c.assign(static_cast<size_t>(nx * ny), 0);
+  }
+  stamps.clear();
+  tileUpdates = 0;
+}
+
+int FogOfWar::findShape(fp_t visionRange)
+{
+  for (size_t i=0; i < shapes.size(); ++i) {
+    if (shapes[i].visionRange == visionRange) {
+      return static_cast<int>(i);
+    }
+  }
+
+  // tiles whose centers are within visionRange of the center tile's center
+
+  Shape s;
+  s.visionRange = visionRange;
+  
+  int r = static_cast<int>(visionRange / TILE_SIZE);
+  
+  for (int dy=-r; dy <= r; ++dy) {
+    int w = 0;
+    while (square(static_cast<fp_t>((w+1) * TILE_SIZE)) +
+           square(static_cast<fp_t>(dy * TILE_SIZE)) <= square(visionRange)) {
+      ++w;
+    }
+    s.halfWidths.push_back(w);
+  }
+
+  shapes.push_back(s);
+  return static_cast<int>(shapes.size()-1);
+}
+
+void FogOfWar::addRow(vector<uint32_t> &c, int y, int x0, int x1, int delta)
+{
+  if (y < 0 || y >= ny) {
+    return;
+  }
+
+  x0 = std::max(x0, 0);
+  x1 = std::min(x1, nx-1);
+
+  for (int x=x0; x <= x1; ++x) {
+    uint32_t &n = c[tileIndex(x, y)];
+    assert(delta > 0 || n > 0);
+    n = static_cast<uint32_t>(static_cast<int>(n) + delta);
+  }
+  
+  if (x1 >= x0) {
+    tileUpdates += static_cast<size_t>(x1 - x0 + 1);
+  }
+}
+
+void FogOfWar::restamp(const Stamp &from, const Stamp &to)
+{
+  const Stamp &any = from.owner >= 0 ? from : to;
+  
+  if (any.owner < 0) {
+    return;
+  }
+  
+  if (from.owner >= 0 && to.owner >= 0 && from.tx == to.tx && from.ty == to.ty) {
+    return;
+  }
+
+  auto &c = counts[static_cast<size_t>(any.owner)];
+  const Shape &s = shapes[static_cast<size_t>(any.shape)];
+  int r = s.radius();
+
+  // row y of a stamp: tiles [x0, x1] (x0 > x1: empty)
+  auto span = [&](const Stamp &st, int y, int &x0, int &x1) {
+    x0 = 1; x1 = 0;
+    if (st.owner < 0 || y < st.ty - r || y > st.ty + r) {
+      return;
+    }
+    int w = s.halfWidths[static_cast<size_t>(y - st.ty + r)];
+    x0 = st.tx - w;
+    x1 = st.tx + w;
+  };
+
+  int fromY = from.owner >= 0 ? from.ty : to.ty;
+  int toY = to.owner >= 0 ? to.ty : from.ty;
+  int yMin = std::min(fromY, toY) - r;
+  int yMax = std::max(fromY, toY) + r;
+
+  for (int y=yMin; y <= yMax; ++y) {
+
+    int f0, f1, t0, t1;
+    span(from, y, f0, f1);
+    span(to, y, t0, t1);
+
+    if (f0 > f1 || t0 > t1 || f1 < t0 || t1 < f0) {
+
+      // disjoint
+      if (f0 <= f1) { addRow(c, y, f0, f1, -1); }
+      if (t0 <= t1) { addRow(c, y, t0, t1, +1); }
+
+    } else {
+
+      // overlapping: only touch the differences at both ends
+      if (f0 < t0) { addRow(c, y, f0, t0-1, -1); }
+      if (t0 < f0) { addRow(c, y, t0, f0-1, +1); }
+      if (f1 > t1) { addRow(c, y, t1+1, f1, -1); }
+      if (t1 > f1) { addRow(c, y, f1+1, t1, +1); }
+    }
+  }
+}
+
+void FogOfWar::add(const Unit &u)
+{
+  size_t id = static_cast<size_t>(u.unitId);
+  
+  if (id >= stamps.size()) {
+    stamps.resize(id+1);
+  }
+
+  assert(stamps[id].owner < 0);
+  
+  Stamp st;
+  st.owner = u.owner;
+  st.tx = tileX(u.pos.x);
+  st.ty = tileY(u.pos.y);
+  st.shape = findShape(u.visionRange);
+
+  Stamp none;
+  none.shape = st.shape;
+  restamp(none, st);
+  stamps[id] = st;
+}
+
+void FogOfWar::remove(int unitId)
+{
+  Stamp &st = stamps[static_cast<size_t>(unitId)];
+  assert(st.owner >= 0);
+  
+  Stamp none;
+  none.shape = st.shape;
+  restamp(st, none);
+  st = none;
+}
+
+void FogOfWar::move(int unitId, const Vec2 &pos)
+{
+  Stamp &st = stamps[static_cast<size_t>(unitId)];
+  assert(st.owner >= 0);
+
+  Stamp to = st;
+  to.tx = tileX(pos.x);
+  to.ty = tileY(pos.y);
+  restamp(st, to);
+  st = to;
+}
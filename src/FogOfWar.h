@@ -0,0 +1,105 @@
+#pragma once
+
+// tile based fog of war
+//
+// each unit's vision disc is rasterised onto its owner's tile grid
+// (32 pixel SC:BW tiles) as reference counts: tile t is covered by unit v
+// iff the distance between the centers of t and v's tile is at most
+// v.visionRange; a tile is seen by a player iff its count is > 0
+//
+// discs are anchored at tile centers, so a unit's footprint only changes
+// when it enters another tile, and then only tiles the disc enters or
+// leaves are updated => cost proportional to movement, not units^2
+
+#include "Global.h"
+#include "Unit.h"
+#include <array>
+#include <vector>
+
+class FogOfWar
+{
+public:
+
+  static constexpr int TILE_SIZE = 32; // pixels
+
+  FogOfWar()
+  {
+    nx = ny = 0;
+  }
+
+  // coordinates [0..width), [0..height) accepted
+  void setup(fp_t width, fp_t height);
+
+  // remove all units
+  void clear();
+
+  // rasterise vision of unit u
+  void add(const Unit &u);
+
+  // remove vision of unit with id unitId
+  void remove(int unitId);
+
+  // unit with id unitId is now at pos
+  void move(int unitId, const Vec2 &pos);
+
+  // can player see pos?
+  bool isSeen(int player, const Vec2 &pos) const
+  {
+    return counts[static_cast<size_t>(player)][tileIndex(tileX(pos.x), tileY(pos.y))] > 0;
+  }
+
+  // number of tiles whose counts changed (statistics)
+  size_t getTileUpdates() const { return tileUpdates; }
+
+private:
+
+  int nx, ny; // tiles
+  std::array<std::vector<uint32_t>, 2> counts; // per player, row major
+
+  // rasterised disc of a unit
+  struct Stamp
+  {
+    int owner = -1;   // -1: unit not present
+    int tx = 0;       // center tile
+    int ty = 0;
+    int shape = 0;    // index in shapes
+  };
+
+  std::vector<Stamp> stamps; // indexed by unit id
+
+  // disc shapes: half widths of tile rows dy = -r..r
+  struct Shape
+  {
+    fp_t visionRange;
+    std::vector<int> halfWidths;
+
+    int radius() const { return static_cast<int>(halfWidths.size() / 2); }
+  };
+
+  std::vector<Shape> shapes;
+  size_t tileUpdates;
+
+  int tileX(fp_t x) const
+  {
+    return std::min(std::max(static_cast<int>(x / TILE_SIZE), 0), nx-1);
+  }
+
+  int tileY(fp_t y) const
+  {
+    return std::min(std::max(static_cast<int>(y / TILE_SIZE), 0), ny-1);
+  }
+
+  size_t tileIndex(int tx, int ty) const
+  {
+    return static_cast<size_t>(ty * nx + tx);
+  }
+
+  int findShape(fp_t visionRange);
+
+  // add delta to counts of tiles in [x0, x1] of row y (clipped)
+  void addRow(std::vector<uint32_t> &c, int y, int x0, int x1, int delta);
+
+  // update counts for disc changing from stamp from to stamp to
+  // (same owner and shape; owner < 0 for an absent disc)
+  void restamp(const Stamp &from, const Stamp &to);
+};
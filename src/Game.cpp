@@ -0,0 +1,285 @@
+#include "Game.h"
+#include "P_Extern.h"
+#include "P_IndCtrl.h"
+#include "Replay.h"
+#include "W_Plain.h"
+#include <chrono>
+#include <limits>
+#include <sstream>
+
+using namespace std;
+namespace po = boost::program_options;
+
+SpatialParams GameSpec::getSpatial() const
+{
+  bool autoEps = qtEps == "auto";
+  fp_t eps = 800;
+
+  if (!autoEps) {
+    istringstream is(qtEps);
+    if (!(is >> eps) || !(is >> ws).eof() || eps < 0) {
+      ERR("bad --qteps " << qtEps);
+    }
+  }
+
+  return SpatialParams(SpatialParams::typeFromString(spatialType), eps, cellSize, autoEps);
+}
+
+
+void Game::addOptions(po::options_description &desc)
+{
+  GameSpec d; // defaults
+
+  desc.add_options()
+    ("world", po::value<string>()->default_value(d.worldType), "set world type")
+    ("wpar", po::value<string>()->default_value(d.wPar), "set world parameters")
+    ("width,w", po::value<fp_t>()->default_value(d.width), "set world width")
+    ("height,h", po::value<fp_t>()->default_value(d.height), "set world height")
+    ("fow", po::bool_switch()->default_value(d.fow), "swtich fog of war on")
+    ("kinetic", po::bool_switch()->default_value(d.kinetic), "predict attack range events (skip range queries when no unit is in range)")
+    ("spatial", po::value<string>()->default_value(d.spatialType), "set spatial index for range queries (qt|grid|lqt|bf)")
+    ("qteps", po::value<string>()->default_value(d.qtEps), "set quadtree split epsilon (0: no qt, 800 good for large W_Plain, auto: tune while running)")
+    ("cellsize", po::value<fp_t>()->default_value(d.cellSize), "set grid cell size (320 = max. vision range)")
+    ("seed,s", po::value<int>()->default_value(d.seed), "set rng seed (0:time)")
+    ("rplayer", po::value<string>()->default_value(d.redPlayer), "set red player")
+    ("bplayer", po::value<string>()->default_value(d.bluePlayer), "set blue player")
+    ("rpar,r", po::value<string>()->default_value(d.rPar), "set red parameters (attack_non|closest|weakest|most_dangerous)")
+    ("bpar,b", po::value<string>()->default_value(d.bPar), "set blue parameters (attack_non|closest|weakest|most_dangerous)")
+    ("steps", po::value<int>()->default_value(d.steps), "maximum steps (-1: infinite)")
+    ("player-threads", po::value<int>()->default_value(d.playerThreads), "set number of threads running the players (1: in turn, 2: concurrently)")
+    ("unit-threads", po::value<int>()->default_value(d.unitThreads), "set number of threads each player uses for its unit decisions");
+}
+
+
+GameSpec Game::specFromOptions(const po::variables_map &vm)
+{
+  GameSpec spec;
+
+  spec.worldType = vm["world"].as<string>();
+  spec.wPar = vm["wpar"].as<string>();
+  spec.width = vm["width"].as<fp_t>();
+  spec.height = vm["height"].as<fp_t>();
+  spec.fow = vm["fow"].as<bool>();
+  spec.kinetic = vm["kinetic"].as<bool>();
+  spec.spatialType = vm["spatial"].as<string>();
+  spec.qtEps = vm["qteps"].as<string>();
+  spec.cellSize = vm["cellsize"].as<fp_t>();
+  spec.seed = vm["seed"].as<int>();
+  spec.redPlayer = vm["rplayer"].as<string>();
+  spec.bluePlayer = vm["bplayer"].as<string>();
+  spec.rPar = vm["rpar"].as<string>();
+  spec.bPar = vm["bpar"].as<string>();
+  spec.steps = vm["steps"].as<int>();
+  spec.playerThreads = vm["player-threads"].as<int>();
+  spec.unitThreads = vm["unit-threads"].as<int>();
+
+  if (spec.seed == 0) {
+    // rng seed dependent on wallclock time
+    auto millis =
+      std::chrono::duration_cast<std::chrono::milliseconds>
+      (std::chrono::system_clock::now().time_since_epoch()).count();
+
+    spec.seed = (int)millis;
+  }
+
+  return spec;
+}
+
+
+void Game::writeSpec(ostream &os, const GameSpec &spec)
+{
+  os << "world:   " << spec.worldType  << endl;
+  os << "wpar:    " << spec.wPar       << endl;
+  os << "width:   " << spec.width      << endl;
+  os << "height:  " << spec.height     << endl;
+  os << "fow:     " << spec.fow        << endl;
+  os << "kinetic: " << spec.kinetic    << endl;
+  os << "spatial: " << spec.spatialType << endl;
+  os << "qteps:   " << spec.qtEps      << endl;
+  os << "cellsize: " << spec.cellSize  << endl;
+  os << "seed:    " << spec.seed       << endl;
+  os << "rplayer: " << spec.redPlayer  << endl;
+  os << "bplayer: " << spec.bluePlayer << endl;
+  os << "rpar:    " << spec.rPar       << endl;
+  os << "bpar:    " << spec.bPar       << endl;
+  os << "steps:   " << spec.steps      << endl;
+  os << "player-threads: " << spec.playerThreads << endl;
+  os << "unit-threads: " << spec.unitThreads << endl;
+}
+
+
+string Game::specToArgs(const GameSpec &spec)
+{
+  ostringstream os;
+
+  // floats round trip
+  os.precision(numeric_limits<fp_t>::max_digits10);
+
+  os << "--world \"" << spec.worldType << "\""
+     << " --wpar \"" << spec.wPar << "\""
+     << " --width " << spec.width
+     << " --height " << spec.height;
+  if (spec.fow) {
+    os << " --fow";
+  }
+  if (spec.kinetic) {
+    os << " --kinetic";
+  }
+  os << " --spatial " << spec.spatialType
+     << " --qteps " << spec.qtEps
+     << " --cellsize " << spec.cellSize
+     << " --seed " << spec.seed
+     << " --rplayer \"" << spec.redPlayer << "\""
+     << " --bplayer \"" << spec.bluePlayer << "\""
+     << " --rpar \"" << spec.rPar << "\""
+     << " --bpar \"" << spec.bPar << "\""
+     << " --steps " << spec.steps
+     << " --player-threads " << spec.playerThreads
+     << " --unit-threads " << spec.unitThreads;
+
+  return os.str();
+}
+
+
+GameSpec Game::specFromArgs(const string &args, const string &what)
+{
+  po::options_description desc("Game");
+  addOptions(desc);
+
+  po::variables_map vm;
+
+  try {
+    po::store(po::command_line_parser(po::split_unix(args)).options(desc).run(), vm);
+    po::notify(vm);
+  } catch (const po::error &e) {
+    ERR(what << ": " << e.what());
+  }
+
+  return specFromOptions(vm);
+}
+
+
+World *Game::newWorld(const string &worldType)
+{
+  if (worldType == "Plain") {
+
+    return new W_Plain();
+
+  } else {
+
+    ERR("unknown world type '" << worldType << "'");
+
+  }
+
+  return nullptr;
+}
+
+
+Player *Game::newPlayer(const string &playerType, World *world,
+                        int index, const string &playerName,
+                        const SpatialParams &spatial,
+                        const string &params, int seed)
+{
+  if (playerType == "IndCtrl") {
+
+    return new P_IndCtrl(world, index, playerName, spatial, params, seed);
+
+  } else if (playerType == "Extern") {
+
+    return new P_Extern(world, index, playerName, spatial, params, seed);
+
+  } else {
+
+    ERR("unknown player type '" << playerType << "'");
+
+  }
+
+  return nullptr;
+}
+
+
+Game::Game(const GameSpec &spec_)
+  : spec(spec_), startTime(Timer::WALLCLOCK)
+{
+  SpatialParams spatial = spec.getSpatial();
+
+  // set up world
+
+  world.reset(newWorld(spec.worldType));
+  world->setKinetic(spec.kinetic);
+  world->setPlayerThreads(spec.playerThreads);
+
+  // set up players
+
+  red.reset(newPlayer(spec.redPlayer,  world.get(), 0, "RED_"  + spec.redPlayer,
+                      spatial, spec.rPar, spec.seed));
+  blue.reset(newPlayer(spec.bluePlayer, world.get(), 1, "BLUE_" + spec.bluePlayer,
+                       spatial, spec.bPar, spec.seed));
+  red->setThreads(spec.unitThreads);
+  blue->setThreads(spec.unitThreads);
+
+  // wire up components
+
+  world->setup(spec.width, spec.height, spec.fow, spec.seed, red.get(), blue.get(),
+               spatial, spec.wPar);
+
+  maxSteps = MAX_STEPS;
+
+  if (spec.steps != -1) {
+    maxSteps = min(spec.steps, maxSteps);
+  }
+}
+
+
+Game::~Game()
+{
+}
+
+
+void Game::record(const string &file, int keyframeInterval)
+{
+  if (world->getFrameCount() != 0) {
+    ERR("Game: recording must start before the first frame");
+  }
+  recorder.reset(new ReplayRecorder(file, spec, *world, keyframeInterval));
+}
+
+
+bool Game::step()
+{
+  if (world->getFrameCount() < maxSteps && world->executeFrame()) {
+    if (recorder) {
+      recorder->onFrame(*world);
+    }
+    return true;
+  }
+
+  if (recorder) {
+    recorder->finish(*world);
+  }
+  return false;
+}
+
+
+GameResult Game::run()
+{
+  startTime.set();
+
+  while (step()) { }
+
+  return result();
+}
+
+
+GameResult Game::result() const
+{
+  GameResult r;
+  Timer now(Timer::WALLCLOCK);
+
+  r.frames = world->getFrameCount();
+  r.timeout = r.frames >= maxSteps;
+  r.score0 = world->score0(r.timeout);
+  r.millis = static_cast<double>(now.diff(startTime)) / 1000.0;
+  r.hash = world->getStateHash();
+  return r;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+// a single game: the command line options describing it (shared by csim and
+// csim_batch), world and player factories, and running it without gfx
+//
+// a game owns its world and players; games don't share any state, so
+// different games can run concurrently on different threads
+
+#include "Global.h"
+#include "World.h"
+#include "Player.h"
+#include <boost/program_options.hpp>
+#include <memory>
+#include <string>
+
+class ReplayRecorder;
+
+struct GameSpec
+{
+  std::string worldType = "Plain";
+  std::string wPar = "100 100";
+  fp_t width = 800, height = 800;
+  bool fow = false;
+  bool kinetic = false;
+  std::string spatialType = "qt";
+  std::string qtEps = "800";  // or "auto"
+  fp_t cellSize = 320;
+  int seed = 0;               // 0: time
+  std::string redPlayer = "IndCtrl", bluePlayer = "IndCtrl";
+  std::string rPar = "attack_closest", bPar = "attack_closest";
+  int steps = -1;             // -1: MAX_STEPS
+  int playerThreads = 1;
+  int unitThreads = 1;
+
+  SpatialParams getSpatial() const;
+};
+
+struct GameResult
+{
+  int frames = 0;
+  int score0 = 0;       // RED's score: 1 win, 0 tie, -1 loss
+  bool timeout = false;
+  double millis = 0;    // wall time
+  uint64_t hash = 0;    // final world state hash
+};
+
+class Game
+{
+public:
+
+  static constexpr int MAX_STEPS = 100'000;
+
+  // register options describing a game (--wpar, --seed, --rpar, ...)
+  static void addOptions(boost::program_options::options_description &desc);
+
+  // read them back; seed 0 is replaced by a time dependent one
+  static GameSpec specFromOptions(const boost::program_options::variables_map &vm);
+
+  static void writeSpec(std::ostream &os, const GameSpec &spec);
+
+  // spec as options for specFromArgs()
+  static std::string specToArgs(const GameSpec &spec);
+
+  // parse options in command line syntax (what: prefix of error messages)
+  static GameSpec specFromArgs(const std::string &args, const std::string &what);
+
+  // add your worlds and players here
+  static World *newWorld(const std::string &worldType);
+  static Player *newPlayer(const std::string &playerType, World *world,
+                           int index, const std::string &playerName,
+                           const SpatialParams &spatial,
+                           const std::string &params, int seed);
+
+  // creates and sets up world and players
+  explicit Game(const GameSpec &spec);
+
+  ~Game();
+
+  // write replay of the following frames to file (before first step)
+  void record(const std::string &file, int keyframeInterval);
+
+  World &getWorld() { return *world; }
+  Player &getPlayer(int i) { return i == 0 ? *red : *blue; }
+  const GameSpec &getSpec() const { return spec; }
+  int getMaxSteps() const { return maxSteps; }
+
+  // execute one frame
+  // @return false if game is over (or step limit reached)
+  bool step();
+
+  // play until game is over
+  GameResult run();
+
+  // result after step() returned false
+  GameResult result() const;
+
+private:
+
+  GameSpec spec;
+  int maxSteps;
+  std::unique_ptr<World> world;
+  std::unique_ptr<Player> red, blue;
+  std::unique_ptr<ReplayRecorder> recorder; // nullptr: not recording
+  Timer startTime;
+};
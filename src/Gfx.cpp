@@ -73,9 +73,8 @@ void Gfx::onDisplay()
     sinTab[j] = sin(angle);
   }
   
-  for (auto &p : world->getUnits()) {
+  for (const Unit &u : world->getUnits()) {
 
-    const Unit &u = p.second;
     // cout << "u " << u.pos.x << " " << u.pos.y << " " << u.radius << endl;
 
     if (u.owner == 0) {
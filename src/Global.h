@@ -4,8 +4,10 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <random>
+#include <vector>
 #include <sys/time.h>
 #include <sys/resource.h>
 
@@ -33,9 +35,119 @@ static_assert(sizeof(sint8) == 8, "size problem");
 using RNG = std::mt19937;
 using fp_t = float4; // for world geometry
 
+// splitmix64 finalizer: every input bit affects every output bit (keyed
+// rngs, state hashing)
+inline uint64_t mix64(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// what random draws are for (part of their key, so e.g. a unit's cooldown
+// jitter and its move target are independent)
+enum class RndPurpose : uint64_t { STREAM = 0, SETUP, PLAYER, COOLDOWN, DECISION };
+
+// counter-based generator: the n-th number drawn is mix64(k + n * gamma)
+// for key hash k of (seed, frame, unit id, purpose), a function of key and
+// n only (like Philox, with splitmix64 as the bijection) - so draws for a
+// unit in a frame don't depend on how many other draws happened before or
+// on which thread, and the state is a single word
+//
+// with a fixed key (e.g. frame 0) it also serves as an ordinary stream
+class KeyedRNG
+{
+public:
+
+  using result_type = uint64_t;
+
+  KeyedRNG(uint64_t seed = 0, uint64_t frame = 0, uint64_t unitId = 0,
+           RndPurpose purpose = RndPurpose::STREAM)
+    : state(mix64(mix64(mix64(mix64(seed) ^ frame) ^ unitId) ^ static_cast<uint64_t>(purpose)))
+  {
+  }
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~static_cast<result_type>(0); }
+
+  result_type operator()()
+  {
+    state += 0x9e3779b97f4a7c15ull;
+    return mix64(state);
+  }
+
+private:
+
+  uint64_t state;
+};
+
 template <typename T>
 constexpr T square(T x) { return x*x; }
 
+// read-only view of a contiguous array
+template <typename T>
+class Span
+{
+public:
+
+  Span(const T *first_ = nullptr, const T *last_ = nullptr)
+    : first(first_), last(last_)
+  {
+  }
+
+  Span(const std::vector<T> &v)
+    : first(v.data()), last(v.data() + v.size())
+  {
+  }
+
+  const T *begin() const { return first; }
+  const T *end() const { return last; }
+
+  size_t size() const { return static_cast<size_t>(last - first); }
+  bool empty() const { return first == last; }
+
+  const T &operator[](size_t i) const { return first[i]; }
+
+private:
+
+  const T *first, *last;
+};
+
+// fixed size bit set, all bits cleared by resize()
+class Bitset
+{
+public:
+
+  void resize(size_t n)
+  {
+    words.assign((n + 63) / 64, 0);
+  }
+
+  // keeps bits < n, new bits are 0
+  void grow(size_t n)
+  {
+    words.resize((n + 63) / 64, 0);
+  }
+
+  void set(size_t i) { words[i / 64] |= uint64_t(1) << (i % 64); }
+
+  void reset(size_t i) { words[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+
+  void assign(size_t i, bool b)
+  {
+    if (b) { set(i); } else { reset(i); }
+  }
+
+  bool test(size_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+
+  // bits [64*k, 64*k+64)
+  uint64_t word(size_t k) const { return words[k]; }
+
+private:
+
+  std::vector<uint64_t> words;
+};
+
 struct Vec2
 {
   fp_t x, y;
@@ -67,7 +179,7 @@ inline std::ostream &operator<<(std::ostream &os, const Vec2 &v)
 
 struct Timer
 {
-  enum Mode { CPU=0, WALLCLOCK };
+  enum Mode { CPU=0, WALLCLOCK, THREAD_CPU }; // THREAD_CPU: calling thread only
 
   Mode mode;
   sint8 micros;
@@ -80,10 +192,14 @@ struct Timer
 
   void set()
   {
-    if (mode == CPU) {
+    if (mode == CPU || mode == THREAD_CPU) {
       struct rusage ru;
-      
+
+#ifdef RUSAGE_THREAD
+      getrusage(mode == CPU ? RUSAGE_SELF : RUSAGE_THREAD, &ru);
+#else
       getrusage(RUSAGE_SELF, &ru);
+#endif
       micros = ru.ru_utime.tv_sec * 1'000'000LL + ru.ru_utime.tv_usec;
 
     } else {
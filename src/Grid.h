@@ -0,0 +1,226 @@
+#pragma once
+
+// uniform grid allowing duplicate points
+// (0,0) = lower left corner
+// requires Point to implement Coor getX(), Coor getY()
+// same interface as Quadtree
+//
+// works best if cells are about as large as typical query ranges
+// (unit ranges are bounded, so this is a good fit for combat queries
+// in dense worlds)
+
+#include "Global.h"
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <typename Point>
+class Grid
+{
+public:
+
+  using Coor = decltype(std::declval<const Point&>().getX());
+  static_assert(std::is_same<Coor, decltype(std::declval<const Point&>().getY())>(),
+                "getX/getY don't match");
+
+  Grid()
+  {
+    width = height = 0;
+    cellSize = 1;
+    nx = ny = 0;
+    allocs = 0;
+  }
+
+  // coordinates [0..width_), [0..height_) accepted
+  // cellSize_ > 0: side length of square cells
+  void setup(Coor width_, Coor height_, Coor cellSize_)
+  {
+    assert(cellSize_ > 0);
+    width = width_;
+    height = height_;
+    cellSize = cellSize_;
+    nx = std::max(1, static_cast<int>(std::ceil(width / cellSize)));
+    ny = std::max(1, static_cast<int>(std::ceil(height / cellSize)));
+    cells.resize(static_cast<size_t>(nx * ny));
+    clear();
+  }
+
+  // remove all points; cells keep their capacity
+  void clear()
+  {
+    for (auto &c : cells) {
+      c.clear();
+    }
+    allocs = 0;
+  }
+
+  // number of heap allocations since last clear()
+  size_t getAllocs() const { return allocs; }
+
+  size_t getCellCount() const { return cells.size(); }
+
+  // memory footprint: cell table plus point buffers
+  size_t getBytes() const
+  {
+    size_t sum = cells.capacity() * sizeof(cells[0]);
+    for (const auto &c : cells) {
+      sum += c.capacity() * sizeof(const Point*);
+    }
+    return sum;
+  }
+
+  void insert(const Point *pp)
+  {
+    add(cellIndex(pp->getX(), pp->getY()), pp);
+  }
+
+  // remove point (located by its current coordinates)
+  // @return true if found
+  bool remove(const Point *pp)
+  {
+    return remove(cellIndex(pp->getX(), pp->getY()), pp);
+  }
+
+  // point pp has moved from (oldX, oldY) to its current coordinates
+  // @return false if point was not found at old location
+  bool update(const Point *pp, Coor oldX, Coor oldY)
+  {
+    int oldCell = cellIndex(oldX, oldY);
+    int newCell = cellIndex(pp->getX(), pp->getY());
+
+    if (oldCell == newCell) {
+      return true;
+    }
+
+    if (!remove(oldCell, pp)) {
+      return false;
+    }
+
+    add(newCell, pp);
+    return true;
+  }
+
+  // point data moved from address oldP to newP (same coordinates)
+  // @return false if oldP was not found
+  bool rebind(const Point *oldP, const Point *newP)
+  {
+    auto &c = cells[static_cast<size_t>(cellIndex(newP->getX(), newP->getY()))];
+    auto it = std::find(c.begin(), c.end(), oldP);
+
+    if (it == c.end()) {
+      return false;
+    }
+
+    *it = newP;
+    return true;
+  }
+
+  // points in [xMin, xMax) x [yMin, yMax)
+  void query(Coor xMin, Coor xMax, Coor yMin, Coor yMax, std::vector<const Point*> &result) const
+  {
+    result.clear();
+
+    int cx0 = cellX(xMin), cx1 = cellX(xMax);
+    int cy0 = cellY(yMin), cy1 = cellY(yMax);
+
+    for (int cy=cy0; cy <= cy1; ++cy) {
+      for (int cx=cx0; cx <= cx1; ++cx) {
+        for (const auto p : cells[static_cast<size_t>(cy * nx + cx)]) {
+          Coor x = p->getX(), y = p->getY();
+          if (x >= xMin && x < xMax && y >= yMin && y < yMax) {
+            result.push_back(p);
+          }
+        }
+      }
+    }
+  }
+
+  // @return true if f(p) is true for a point p in [xMin, xMax) x [yMin, yMax)
+  // (stops at first hit)
+  template <typename F>
+  bool any(Coor xMin, Coor xMax, Coor yMin, Coor yMax, F f) const
+  {
+    int cx0 = cellX(xMin), cx1 = cellX(xMax);
+    int cy0 = cellY(yMin), cy1 = cellY(yMax);
+
+    for (int cy=cy0; cy <= cy1; ++cy) {
+      for (int cx=cx0; cx <= cx1; ++cx) {
+        for (const auto p : cells[static_cast<size_t>(cy * nx + cx)]) {
+          Coor x = p->getX(), y = p->getY();
+          if (x >= xMin && x < xMax && y >= yMin && y < yMax && f(p)) {
+            return true;
+          }
+        }
+      }
+    }
+    return false;
+  }
+
+  // points p with dist2((x, y), p) < r^2
+  void queryCircle(Coor x, Coor y, Coor r, std::vector<const Point*> &result) const
+  {
+    result.clear();
+
+    Coor r2 = r*r;
+    int cx0 = cellX(x - r), cx1 = cellX(x + r);
+    int cy0 = cellY(y - r), cy1 = cellY(y + r);
+
+    for (int cy=cy0; cy <= cy1; ++cy) {
+      for (int cx=cx0; cx <= cx1; ++cx) {
+        for (const auto p : cells[static_cast<size_t>(cy * nx + cx)]) {
+          if (square(x - p->getX()) + square(y - p->getY()) < r2) {
+            result.push_back(p);
+          }
+        }
+      }
+    }
+  }
+
+private:
+
+  Coor width, height;
+  Coor cellSize;
+  int nx, ny;
+  std::vector<std::vector<const Point*>> cells; // row major
+  size_t allocs;
+
+  // cell coordinates, clipped to grid
+  int cellX(Coor x) const
+  {
+    return std::min(std::max(static_cast<int>(x / cellSize), 0), nx-1);
+  }
+
+  int cellY(Coor y) const
+  {
+    return std::min(std::max(static_cast<int>(y / cellSize), 0), ny-1);
+  }
+
+  int cellIndex(Coor x, Coor y) const
+  {
+    return cellY(y) * nx + cellX(x);
+  }
+
+  void add(int cell, const Point *pp)
+  {
+    auto &c = cells[static_cast<size_t>(cell)];
+    if (c.size() == c.capacity()) {
+      ++allocs;
+    }
+    c.push_back(pp);
+  }
+
+  bool remove(int cell, const Point *pp)
+  {
+    auto &c = cells[static_cast<size_t>(cell)];
+    auto it = std::find(c.begin(), c.end(), pp);
+
+    if (it == c.end()) {
+      return false;
+    }
+
+    *it = c.back();
+    c.pop_back();
+    return true;
+  }
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+// hands out small non-negative integer ids (e.g. unit ids of one world)
+//
+// released ids are handed out again (most recently released first), so ids
+// stay dense and tables indexed by id don't grow without bound
+
+#include <cassert>
+#include <vector>
+
+class IdAllocator
+{
+public:
+
+  void clear()
+  {
+    next = 0;
+    freeIds.clear();
+  }
+
+  int alloc()
+  {
+    if (!freeIds.empty()) {
+      int id = freeIds.back();
+      freeIds.pop_back();
+      return id;
+    }
+    return next++;
+  }
+
+  void release(int id)
+  {
+    assert(id >= 0 && id < next);
+    freeIds.push_back(id);
+  }
+
+  // all ids handed out so far are < bound
+  int getBound() const { return next; }
+
+  // released ids not handed out again (next alloc() takes the last one)
+  const std::vector<int> &getFreeIds() const { return freeIds; }
+
+  // restore state given by getBound() and getFreeIds()
+  void restore(int bound, const std::vector<int> &freeIds_)
+  {
+    next = bound;
+    freeIds = freeIds_;
+  }
+
+private:
+
+  int next = 0;
+  std::vector<int> freeIds;
+};
@@ -0,0 +1,408 @@
+#include "KineticRanges.h"
+#include "World.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+void KineticRanges::setup(fp_t width_, fp_t height_)
+{
+  clear();
+  width = width_;
+  height = height_;
+}
+
+void KineticRanges::clear()
+{
+  units.clear();
+  inRange.clear();
+  pairs.clear();
+  freePairs.clear();
+  for (auto &b : events) {
+    b.clear();
+  }
+  lastFrame = -1;
+  dirtyUnits.clear();
+  frame = 0;
+  inRangePairs = 0;
+  nextGen = 0;
+  width = height = 0;
+  maxAttackRange = { 0, 0 };
+  maxRadius = { 0, 0 };
+  maxSpeed = { 0, 0 };
+  eventCount = replanCount = quietFrames = 0;
+}
+
+void KineticRanges::add(const Unit &u)
+{
+  assert(u.owner == 0 || u.owner == 1);
+
+  size_t id = static_cast<size_t>(u.unitId);
+
+  if (id >= units.size()) {
+    units.resize(id+1);
+    inRange.resize(id+1, 0);
+  }
+
+  UnitInfo &info = units[id];
+  info.owner = u.owner;
+  info.gen = ++nextGen;
+  info.plannedAt = -1;
+  info.dirty = false;
+  info.pairIds.clear();
+
+  size_t o = static_cast<size_t>(u.owner);
+  maxAttackRange[o] = max(maxAttackRange[o], u.attackRange);
+  maxRadius[o] = max(maxRadius[o], u.radius);
+  maxSpeed[o] = max(maxSpeed[o], u.maxSpeed);
+
+  invalidate(u.unitId);
+}
+
+void KineticRanges::remove(int unitId)
+{
+  UnitInfo &info = units[static_cast<size_t>(unitId)];
+  assert(info.owner >= 0);
+
+  while (!info.pairIds.empty()) {
+    dropPair(unitId, info.pairIds.size()-1);
+  }
+
+  info.owner = -1;
+  info.gen = ++nextGen;
+  info.dirty = false;
+}
+
+void KineticRanges::invalidate(int unitId)
+{
+  UnitInfo &info = units[static_cast<size_t>(unitId)];
+
+  if (info.owner >= 0 && !info.dirty) {
+    info.dirty = true;
+    dirtyUnits.push_back(unitId);
+  }
+}
+
+void KineticRanges::update(int frame_, const UnitStore &store,
+                           const array<const SpatialIndex<Unit>*, 2> &indexes)
+{
+  frame = frame_;
+
+  // due events (stale ones are skipped)
+
+  while (lastFrame < frame) {
+
+    ++lastFrame;
+    vector<Event> &bucket = events[static_cast<size_t>(lastFrame % BUCKETS)];
+
+    for (const Event &e : bucket) {
+
+      if (e.type == ENTER || e.type == EXIT) {
+
+        Pair &p = pairs[static_cast<size_t>(e.id)];
+
+        if (p.gen != e.gen) {
+          continue;
+        }
+
+        if (e.type == ENTER) {
+          assert(!p.counted);
+          p.counted = true;
+          count(p.a, p.b, 1);
+          push(p.exit, EXIT, e.id, p.gen);
+        } else if (p.counted) {
+          p.counted = false;
+          count(p.a, p.b, -1);
+        }
+
+      } else {
+
+        if (units[static_cast<size_t>(e.id)].gen != e.gen) {
+          continue;
+        }
+
+        invalidate(e.id);
+      }
+
+      ++eventCount;
+    }
+
+    bucket.clear();
+  }
+
+  // re-plan units whose trajectories changed (in id order, so that event
+  // order doesn't depend on action order)
+
+  sort(dirtyUnits.begin(), dirtyUnits.end());
+
+  for (int id : dirtyUnits) {
+    if (units[static_cast<size_t>(id)].dirty) {
+      replan(id, store, indexes);
+    }
+  }
+
+  dirtyUnits.clear();
+
+  if (inRangePairs == 0) {
+    ++quietFrames;
+  }
+
+  if (CHECK) {
+    check(store);
+  }
+}
+
+/*
+  motion steps add delta to positions in floats; relative to the exact
+  prediction each step adds at most half an ulp of the coordinate, i.e.
+  maxCoord * 2^-24 per coordinate and unit; over HORIZON+1 steps and for
+  two units that's 2 * sqrt(2) * (HORIZON+1) * maxCoord * 2^-24 (rounded
+  up to 3), plus slack for the rounding of the range test itself
+*/
+double KineticRanges::margin() const
+{
+  double maxCoord = max(width, height) + 1;
+  return 3.0 * (HORIZON+1) * maxCoord * pow(2.0, -24) + 0.01;
+}
+
+KineticRanges::Motion KineticRanges::motion(const Unit &u)
+{
+  Motion mo;
+
+  mo.px = u.pos.x;
+  mo.py = u.pos.y;
+  mo.m = u.moveCount;
+
+  if (mo.m > 0) {
+    mo.dx = u.delta.x;
+    mo.dy = u.delta.y;
+    mo.tx = u.targetPos.x;
+    mo.ty = u.targetPos.y;
+  } else {
+    mo.dx = mo.dy = 0;
+    mo.tx = mo.px;
+    mo.ty = mo.py;
+  }
+
+  return mo;
+}
+
+// integer k in [k0, k1] with |c + k * e| < r => [lo, hi]
+// @return false if none
+static bool pieceInterval(double cx, double cy, double ex, double ey, double r,
+                          int k0, int k1, int &lo, int &hi)
+{
+  if (k0 > k1) {
+    return false;
+  }
+
+  double a = ex*ex + ey*ey;
+  double b = 2 * (cx*ex + cy*ey);
+  double c = cx*cx + cy*cy - r*r;
+
+  if (a == 0) {
+
+    // constant distance
+    if (c >= 0) {
+      return false;
+    }
+    lo = k0;
+    hi = k1;
+    return true;
+  }
+
+  double disc = b*b - 4*a*c;
+
+  if (disc < 0) {
+    return false;
+  }
+
+  double s = sqrt(disc);
+  double t0 = (-b - s) / (2*a);
+  double t1 = (-b + s) / (2*a);
+
+  // clip before converting to int
+  t0 = max(t0, static_cast<double>(k0));
+  t1 = min(t1, static_cast<double>(k1));
+
+  if (t0 > t1) {
+    return false;
+  }
+
+  lo = static_cast<int>(ceil(t0));
+  hi = static_cast<int>(floor(t1));
+  return lo <= hi;
+}
+
+bool KineticRanges::interval(const Motion &u, const Motion &v, double r, int &enter, int &exit)
+{
+  // pieces: both moving [0, mMin), one arrived [mMin, mMax), both arrived
+  // [mMax, HORIZON]
+
+  int mMin = min(u.m, v.m);
+  int mMax = max(u.m, v.m);
+  int lo, hi;
+  bool found = false;
+
+  auto piece = [&](double cx, double cy, double ex, double ey, int k0, int k1) {
+    if (pieceInterval(cx, cy, ex, ey, r, k0, min(k1, HORIZON), lo, hi)) {
+      if (!found) {
+        enter = lo;
+      }
+      exit = hi + 1;
+      found = true;
+    }
+  };
+
+  piece(u.px - v.px, u.py - v.py, u.dx - v.dx, u.dy - v.dy, 0, mMin-1);
+
+  if (u.m <= v.m) {
+    piece(u.tx - v.px, u.ty - v.py, -v.dx, -v.dy, mMin, mMax-1);
+  } else {
+    piece(u.px - v.tx, u.py - v.ty, u.dx, u.dy, mMin, mMax-1);
+  }
+
+  piece(u.tx - v.tx, u.ty - v.ty, 0, 0, mMax, HORIZON);
+
+  return found;
+}
+
+void KineticRanges::replan(int id, const UnitStore &store,
+                           const array<const SpatialIndex<Unit>*, 2> &indexes)
+{
+  UnitInfo &info = units[static_cast<size_t>(id)];
+  int slot = store.slotOf(id);
+  assert(slot >= 0);
+
+  ++replanCount;
+
+  // pairs with units planned in this frame are current
+
+  for (size_t i=info.pairIds.size(); i-- > 0; ) {
+    const Pair &p = pairs[static_cast<size_t>(info.pairIds[i])];
+    if (units[static_cast<size_t>(p.a == id ? p.b : p.a)].plannedAt != frame) {
+      dropPair(id, i);
+    }
+  }
+
+  info.gen = ++nextGen;
+  info.plannedAt = frame;
+  info.dirty = false;
+
+  // opponents that can get within range in the next HORIZON frames
+
+  const Unit &u = store.record(slot);
+  Motion mu = motion(u);
+  size_t opp = static_cast<size_t>(1-info.owner);
+  double eps = margin();
+  double rMax = max(u.attackRange + maxRadius[opp], maxAttackRange[opp] + u.radius);
+  double speed = sqrt(mu.dx*mu.dx + mu.dy*mu.dy);
+  double d = rMax + (speed + maxSpeed[opp]) * (HORIZON+1) + eps;
+
+  candidates.clear();
+
+  if (indexes[opp]) {
+    indexes[opp]->queryCircle(u.pos.x, u.pos.y, static_cast<fp_t>(d), candidates);
+  } else {
+    for (const Unit &v : store.getUnits(static_cast<int>(opp))) {
+      candidates.push_back(&v);
+    }
+  }
+
+  for (const Unit *v : candidates) {
+
+    const UnitInfo &vInfo = units[static_cast<size_t>(v->unitId)];
+
+    if (vInfo.plannedAt == frame) {
+      continue; // pair determined when v was planned
+    }
+
+    Motion mv = motion(*v);
+    double r = max(u.attackRange + v->radius, v->attackRange + u.radius) + eps;
+    int enter, exit;
+
+    if (interval(mu, mv, r, enter, exit)) {
+      addPair(id, v->unitId, enter, exit);
+    }
+  }
+
+  push(frame + HORIZON, REPLAN, id, info.gen);
+}
+
+void KineticRanges::dropPair(int id, size_t i)
+{
+  vector<int> &pairIds = units[static_cast<size_t>(id)].pairIds;
+  int pid = pairIds[i];
+  Pair &p = pairs[static_cast<size_t>(pid)];
+
+  if (p.counted) {
+    count(p.a, p.b, -1);
+  }
+
+  pairIds[i] = pairIds.back();
+  pairIds.pop_back();
+
+  vector<int> &otherIds = units[static_cast<size_t>(p.a == id ? p.b : p.a)].pairIds;
+  auto it = find(otherIds.begin(), otherIds.end(), pid);
+  assert(it != otherIds.end());
+  *it = otherIds.back();
+  otherIds.pop_back();
+
+  p.gen = 0;
+  freePairs.push_back(pid);
+}
+
+void KineticRanges::addPair(int a, int b, int enter, int exit)
+{
+  int pid;
+
+  if (freePairs.empty()) {
+    pid = static_cast<int>(pairs.size());
+    pairs.emplace_back();
+  } else {
+    pid = freePairs.back();
+    freePairs.pop_back();
+  }
+
+  Pair &p = pairs[static_cast<size_t>(pid)];
+  p.a = a;
+  p.b = b;
+  p.gen = ++nextGen;
+  p.exit = frame + exit;
+  p.counted = enter <= 0;
+
+  if (p.counted) {
+    count(a, b, 1);
+    push(p.exit, EXIT, pid, p.gen);
+  } else {
+    push(frame + enter, ENTER, pid, p.gen);
+  }
+
+  units[static_cast<size_t>(a)].pairIds.push_back(pid);
+  units[static_cast<size_t>(b)].pairIds.push_back(pid);
+}
+
+void KineticRanges::check(const UnitStore &store) const
+{
+  for (const Unit &u : store.getUnits(0)) {
+    for (const Unit &v : store.getUnits(1)) {
+
+      if (!World::canAttack(u, v) && !World::canAttack(v, u)) {
+        continue;
+      }
+
+      bool counted = false;
+
+      for (int pid : units[static_cast<size_t>(u.unitId)].pairIds) {
+        const Pair &p = pairs[static_cast<size_t>(pid)];
+        if ((p.a == v.unitId || p.b == v.unitId) && p.counted) {
+          counted = true;
+        }
+      }
+
+      if (!counted || !inRange[static_cast<size_t>(u.unitId)] || !inRange[static_cast<size_t>(v.unitId)]) {
+        ERR("kinetic: pair " << u.unitId << " " << v.unitId << " in range, but not counted");
+      }
+    }
+  }
+}
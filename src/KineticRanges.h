@@ -0,0 +1,168 @@
+#pragma once
+
+// kinetic prediction of opponent pairs within attack range (--kinetic)
+//
+// between actions units move on straight lines: k frames from now a unit
+// with moveCount m > k is at pos + k * delta, afterwards at targetPos (the
+// last motion step snaps to the target); so the frames in which two units
+// are within range R of each other follow in closed form - one quadratic
+// per piece of their relative motion, which changes when one unit arrives
+//
+// only pairs which can get within range in the next HORIZON frames are
+// tracked: opponents within R + (speed + max. opponent speed) * HORIZON,
+// found with the world's spatial indexes; a unit re-plans its pairs when
+// its trajectory changes (actions, border collisions) and at the latest
+// every HORIZON frames
+//
+// predicted range entries and exits and re-planning are events
+// in a priority queue ordered by frame - as no event lies more than
+// HORIZON+1 frames ahead, a ring of per-frame buckets (calendar queue);
+// re-planning a unit invalidates the queued events of its pairs (generation
+// numbers, lazy deletion)
+//
+// pairs are conservative - the range covers both attack directions plus a
+// margin for float rounding, and in-range intervals of a pair are merged -
+// so if getInRangePairs() == 0 no unit can attack and players can skip
+// range queries
+//
+// positions are predicted from the state at planning time, and pairs are
+// re-planned within HORIZON frames, so float rounding of the motion steps
+// accumulates over at most HORIZON steps (see margin())
+
+#include "Global.h"
+#include "Unit.h"
+#include "UnitStore.h"
+#include "SpatialIndex.h"
+#include <array>
+#include <vector>
+
+class KineticRanges
+{
+public:
+
+  static constexpr int HORIZON = 32; // frames between re-planning
+  static constexpr bool CHECK = false; // verify counts by brute force (slow)
+
+  KineticRanges()
+  {
+    clear();
+  }
+
+  void setup(fp_t width, fp_t height);
+
+  // remove all units
+  void clear();
+
+  // new unit (trajectory from store when planned)
+  void add(const Unit &u);
+
+  // unit died
+  void remove(int unitId);
+
+  // trajectory of unit changed
+  void invalidate(int unitId);
+
+  // advance to frame: process due events and re-plan units
+  // store: unit records (published, i.e. current)
+  // indexes: spatial indexes over the store's records (nullptr: none)
+  void update(int frame, const UnitStore &store,
+              const std::array<const SpatialIndex<Unit>*, 2> &indexes);
+
+  // number of pairs possibly within attack range in current frame
+  int getInRangePairs() const { return inRangePairs; }
+
+  // same per unit, indexed by unit id
+  const std::vector<int> &getInRangeCounts() const { return inRange; }
+
+  // statistics
+  size_t getEvents() const { return eventCount; }
+  size_t getReplans() const { return replanCount; }
+  size_t getPairs() const { return pairs.size() - freePairs.size(); }
+  size_t getQuietFrames() const { return quietFrames; } // no pair in range
+
+private:
+
+  struct UnitInfo
+  {
+    int owner = -1;          // -1: not present
+    uint32_t gen = 0;        // changes when re-planned (or removed)
+    int plannedAt = -1;      // frame
+    bool dirty = false;      // re-plan in next update
+    std::vector<int> pairIds;  // tracked pairs of unit
+  };
+
+  struct Pair
+  {
+    int a, b;      // unit ids
+    uint32_t gen;  // 0: free
+    int exit;      // frame
+    bool counted;  // in inRangePairs
+  };
+
+  enum Type { ENTER=0, EXIT, REPLAN };
+
+  struct Event
+  {
+    Type type;
+    int id;        // pair id (ENTER, EXIT) or unit id
+    uint32_t gen;  // pair or unit generation when queued
+  };
+
+  static constexpr int BUCKETS = HORIZON+2;
+
+  // position k frames ahead: k < m ? p + k * d : t
+  struct Motion
+  {
+    double px, py, dx, dy, tx, ty;
+    int m;
+  };
+
+  std::vector<UnitInfo> units; // indexed by id
+  std::vector<int> inRange;    // same
+  std::vector<Pair> pairs;     // tracked pairs with non-empty interval
+  std::vector<int> freePairs;  // unused entries of pairs
+  std::array<std::vector<Event>, BUCKETS> events; // events of frame f in f % BUCKETS
+  int lastFrame;               // events processed up to here
+  std::vector<int> dirtyUnits;
+  std::vector<const Unit*> candidates;
+  int frame;
+  int inRangePairs;
+  uint32_t nextGen;
+  fp_t width, height;
+  std::array<fp_t, 2> maxAttackRange, maxRadius, maxSpeed;
+  size_t eventCount, replanCount, quietFrames;
+
+  // bound for float rounding differences between predicted and simulated
+  // positions of two units
+  double margin() const;
+
+  static Motion motion(const Unit &u);
+
+  // frames [enter, exit) relative to now (within HORIZON) in which the
+  // distance of u and v may be < r (merged); @return false if none
+  static bool interval(const Motion &u, const Motion &v, double r, int &enter, int &exit);
+
+  // ERR if an attack is possible but not counted (brute force)
+  void check(const UnitStore &store) const;
+
+  void replan(int id, const UnitStore &store,
+              const std::array<const SpatialIndex<Unit>*, 2> &indexes);
+
+  // untrack pair units[id].pairIds[i]
+  void dropPair(int id, size_t i);
+
+  void addPair(int a, int b, int enter, int exit);
+
+  void count(int a, int b, int d)
+  {
+    inRangePairs += d;
+    inRange[static_cast<size_t>(a)] += d;
+    inRange[static_cast<size_t>(b)] += d;
+  }
+
+  void push(int f, Type type, int id, uint32_t gen)
+  {
+    assert(f > lastFrame && f - lastFrame < BUCKETS);
+    events[static_cast<size_t>(f % BUCKETS)].push_back({ type, id, gen });
+  }
+};
@@ -0,0 +1,387 @@
+#pragma once
+
+// linear (pointerless) quadtree over points, allowing duplicate points
+// (0,0) = lower left corner
+// requires Point to implement Coor getX(), Coor getY()
+//
+// points are quantised to 16 bits per axis and sorted by their 32-bit
+// Morton (z-order) code; every quadtree cell then corresponds to a
+// contiguous range of the sorted array, which queries find by binary
+// search while descending the implicit tree
+//
+// the structure is built in bulk: insert() collects points, build() radix
+// sorts them (O(n), no allocation once buffers have grown); points must not
+// move or be removed between build() and queries - rebuild instead
+
+#include "Global.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <typename Point>
+class LinearQuadtree
+{
+public:
+
+  using Coor = decltype(std::declval<const Point&>().getX());
+  static_assert(std::is_same<Coor, decltype(std::declval<const Point&>().getY())>(),
+                "getX/getY don't match");
+
+  LinearQuadtree()
+  {
+    width = height = 1;
+    scaleX = scaleY = 1;
+    sorted = true;
+    allocs = 0;
+  }
+
+  // coordinates [0..width_), [0..height_) accepted
+  void setup(Coor width_, Coor height_)
+  {
+    width = width_;
+    height = height_;
+    scaleX = static_cast<Coor>(CELLS) / width;
+    scaleY = static_cast<Coor>(CELLS) / height;
+    clear();
+  }
+
+  // remove all points; buffers keep their capacity
+  void clear()
+  {
+    entries.clear();
+    sorted = true;
+    allocs = 0;
+  }
+
+  // number of heap allocations since last clear()
+  size_t getAllocs() const { return allocs; }
+
+  size_t size() const { return entries.size(); }
+
+  // memory footprint: entry array plus radix sort buffer
+  size_t getBytes() const
+  {
+    return (entries.capacity() + tmp.capacity()) * sizeof(Entry);
+  }
+
+  // add point; takes effect with next build()
+  void insert(const Point *pp)
+  {
+    if (entries.size() == entries.capacity()) {
+      ++allocs;
+    }
+
+    Coor x = pp->getX(), y = pp->getY();
+    entries.push_back({ morton(quantX(x), quantY(y)), x, y, pp });
+    sorted = false;
+  }
+
+  // sort points by Morton code
+  // (stable: points with equal codes keep their insertion order)
+  void build()
+  {
+    if (!sorted) {
+      radixSort();
+      sorted = true;
+    }
+  }
+
+  // points in [xMin, xMax) x [yMin, yMax)
+  void query(Coor xMin, Coor xMax, Coor yMin, Coor yMax, std::vector<const Point*> &result) const
+  {
+    result.clear();
+    assert(sorted);
+
+    if (entries.empty() || xMin >= xMax || yMin >= yMax) {
+      return;
+    }
+
+    Box box{ quantX(xMin), quantX(xMax), quantY(yMin), quantY(yMax) };
+
+    query(box,
+          [&](const Entry &e) {
+            return e.x >= xMin && e.x < xMax && e.y >= yMin && e.y < yMax;
+          },
+          [&](const Point *p) { result.push_back(p); return false; });
+  }
+
+  // @return true if f(p) is true for a point p in [xMin, xMax) x [yMin, yMax)
+  // (stops at first hit)
+  template <typename F>
+  bool any(Coor xMin, Coor xMax, Coor yMin, Coor yMax, F f) const
+  {
+    assert(sorted);
+
+    if (entries.empty() || xMin >= xMax || yMin >= yMax) {
+      return false;
+    }
+
+    Box box{ quantX(xMin), quantX(xMax), quantY(yMin), quantY(yMax) };
+
+    return query(box,
+                 [&](const Entry &e) {
+                   return e.x >= xMin && e.x < xMax && e.y >= yMin && e.y < yMax;
+                 },
+                 f);
+  }
+
+  // points p with dist2((x, y), p) < r^2
+  void queryCircle(Coor x, Coor y, Coor r, std::vector<const Point*> &result) const
+  {
+    result.clear();
+    assert(sorted);
+
+    if (entries.empty() || r <= 0) {
+      return;
+    }
+
+    Coor r2 = r*r;
+    Box box{ quantX(x - r), quantX(x + r), quantY(y - r), quantY(y + r) };
+
+    // cells inside the bounding box aren't necessarily inside the
+    // circle => no bulk reporting
+    box.inner = false;
+
+    query(box,
+          [&](const Entry &e) { return square(e.x - x) + square(e.y - y) < r2; },
+          [&](const Point *p) { result.push_back(p); return false; });
+  }
+
+private:
+
+  static constexpr int LEVELS = 16;              // bits per axis
+  static constexpr uint32_t CELLS = 1u << LEVELS; // quantised cells per axis
+  static constexpr size_t LEAF_SIZE = 32;         // scan ranges up to this size
+
+  struct Entry
+  {
+    uint32_t code;
+    Coor x, y;   // copies, so queries don't chase pointers
+    const Point *p;
+  };
+
+  // query box in quantised coordinates (inclusive)
+  struct Box
+  {
+    uint32_t x0, x1, y0, y1;
+    bool inner = true; // report cells strictly inside without testing
+  };
+
+  Coor width, height;
+  Coor scaleX, scaleY;  // world -> quantised coordinates
+  std::vector<Entry> entries, tmp;
+  bool sorted;
+  size_t allocs;
+
+  // quantisation is monotone, so x < x' => quantX(x) <= quantX(x'),
+  // and quantX(x) < quantX(x') => x < x'; cells can thus be pruned
+  // (and reported in bulk) in quantised space without rounding issues
+
+  uint32_t quantX(Coor x) const { return quant(x * scaleX); }
+  uint32_t quantY(Coor y) const { return quant(y * scaleY); }
+
+  static uint32_t quant(Coor v)
+  {
+    if (!(v > 0)) {
+      return 0;
+    }
+    if (v >= static_cast<Coor>(CELLS - 1)) {
+      return CELLS - 1;
+    }
+    return static_cast<uint32_t>(v);
+  }
+
+  // spread lower 16 bits to even bit positions
+  static uint32_t spread(uint32_t v)
+  {
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+  }
+
+  // x bits on even, y bits on odd positions
+  static uint32_t morton(uint32_t qx, uint32_t qy)
+  {
+    return spread(qx) | (spread(qy) << 1);
+  }
+
+  // LSD radix sort by code, 8 bits per pass; passes in which all
+  // codes share the same digit are skipped
+  void radixSort()
+  {
+    size_t n = entries.size();
+
+    if (tmp.capacity() < n) {
+      ++allocs;
+    }
+    tmp.resize(n);
+
+    std::array<std::array<size_t, 256>, 4> counts{};
+
+    for (const auto &e : entries) {
+      for (size_t d=0; d < 4; ++d) {
+        ++counts[d][(e.code >> (8*d)) & 0xff];
+      }
+    }
+
+    for (size_t d=0; d < 4; ++d) {
+
+      auto &c = counts[d];
+
+      if (c[(entries[0].code >> (8*d)) & 0xff] == n) {
+        continue;
+      }
+
+      // prefix sums => start offsets
+      size_t sum = 0;
+      for (auto &v : c) {
+        size_t t = v;
+        v = sum;
+        sum += t;
+      }
+
+      for (const auto &e : entries) {
+        tmp[c[(e.code >> (8*d)) & 0xff]++] = e;
+      }
+
+      entries.swap(tmp);
+    }
+  }
+
+  // first entry in [lo, hi) with code >= code
+  size_t lowerBound(size_t lo, size_t hi, uint32_t code) const
+  {
+    return static_cast<size_t>(
+      std::lower_bound(entries.begin() + static_cast<std::ptrdiff_t>(lo),
+                       entries.begin() + static_cast<std::ptrdiff_t>(hi), code,
+                       [](const Entry &e, uint32_t c) { return e.code < c; })
+      - entries.begin());
+  }
+
+  // cover the query box with at most 2x2 cells which are at least as
+  // large as the box and descend from each of them
+  // (cheaper than starting at the smallest enclosing cell, which is
+  // the root for boxes straddling the center)
+  // test(entry): entry matches query
+  // report(point): handle match, true => stop
+  // @return true if stopped
+  template <typename Test, typename Report>
+  bool query(const Box &box, const Test &test, Report &&report) const
+  {
+    uint32_t extent = std::max(box.x1 - box.x0, box.y1 - box.y0) + 1;
+    
+    int level = 0;
+    while ((1u << level) < extent) {
+      ++level;
+    }
+
+    uint32_t mask = ~((1u << level) - 1);
+    uint32_t cx[2] = { box.x0 & mask, box.x1 & mask };
+    uint32_t cy[2] = { box.y0 & mask, box.y1 & mask };
+    uint64_t codes = uint64_t(1) << (2*level);  // codes per cell
+
+    // covering cells in Morton order, so results come in code order (and
+    // keep their relative order when the box grows)
+
+    struct Cell { uint32_t base, cx, cy; };
+    std::array<Cell, 4> cells;
+    size_t n = 0;
+    
+    for (int j=0; j < 2; ++j) {
+      if (j == 1 && cy[1] == cy[0]) {
+        break;
+      }
+      for (int i=0; i < 2; ++i) {
+        if (i == 1 && cx[1] == cx[0]) {
+          break;
+        }
+        cells[n++] = { morton(cx[i], cy[j]), cx[i], cy[j] };
+      }
+    }
+
+    // built in (x, y) order; codes grow with each coordinate, so only the
+    // middle two of four cells can be out of order
+    if (n == 4 && cells[2].base < cells[1].base) {
+      std::swap(cells[1], cells[2]);
+    }
+
+    size_t lo = 0;
+    for (size_t k=0; k < n; ++k) {
+      const Cell &c = cells[k];
+      lo = lowerBound(lo, entries.size(), c.base);
+      size_t hi = entries.size();
+      if (c.base + codes <= UINT32_MAX) {
+        hi = lowerBound(lo, hi, static_cast<uint32_t>(c.base + codes));
+      }
+
+      if (query(c.cx, c.cy, level, lo, hi, box, test, report)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // cell with quantised lower left corner (cx, cy) and side 2^level
+  // whose points occupy entries [lo, hi)
+  template <typename Test, typename Report>
+  bool query(uint32_t cx, uint32_t cy, int level, size_t lo, size_t hi,
+             const Box &box, const Test &test, Report &report) const
+  {
+    if (lo == hi) {
+      return false;
+    }
+
+    uint32_t side = 1u << level;
+    uint32_t cx1 = cx + (side - 1), cy1 = cy + (side - 1);
+
+    if (cx > box.x1 || cx1 < box.x0 || cy > box.y1 || cy1 < box.y0) {
+      return false; // disjoint
+    }
+
+    if (box.inner && cx > box.x0 && cx1 < box.x1 && cy > box.y0 && cy1 < box.y1) {
+      // strictly inside => all points match
+      for (size_t i=lo; i < hi; ++i) {
+        if (report(entries[i].p)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    if (hi - lo <= LEAF_SIZE || level == 0) {
+      for (size_t i=lo; i < hi; ++i) {
+        if (test(entries[i]) && report(entries[i].p)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // children in Morton order: bit 0 = x half, bit 1 = y half
+    --level;
+    uint32_t half = 1u << level;
+    uint32_t base = morton(cx, cy);
+    uint64_t quarter = uint64_t(1) << (2*level); // codes per child
+
+    size_t start = lo;
+
+    for (uint32_t k=0; k < 4; ++k) {
+      size_t end = hi;
+      if (k < 3) {
+        end = lowerBound(start, hi, static_cast<uint32_t>(base + (k+1) * quarter));
+      }
+      if (query(cx + ((k & 1) ? half : 0), cy + ((k & 2) ? half : 0), level,
+                start, end, box, test, report)) {
+        return true;
+      }
+      start = end;
+    }
+    return false;
+  }
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+// player whose actions are set from outside before each frame (e.g. by
+// VecWorld for ML code); onFrame just submits them
+
+#include "Player.h"
+
+class P_Extern : public Player
+{
+public:
+
+  P_Extern(World *world_, int playerId_, const std::string &name_,
+           const SpatialParams &spatial_,
+           const std::string &pol_, int seed_)
+  {
+    setup(world_, playerId_, name_, spatial_, pol_, seed_);
+  }
+
+  // actions submitted in next frame (own units only)
+  void clearActions() { actions.clear(); }
+  void addAction(int unitId, const Action &a) { actions.push_back({ unitId, a }); }
+
+  void onFrame(int /*frameCount*/) override
+  {
+    for (const auto &p : actions) {
+      self().addAction(p.first, p.second);
+    }
+    actions.clear();
+  }
+
+  void onGameEnd() override { }
+
+private:
+
+  std::vector<std::pair<int, Action>> actions;
+};
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include "PlayerView.h"
 #include "P_IndCtrl.h"
@@ -41,7 +42,27 @@ P_IndCtrl::Policy P_IndCtrl::policyFromString(const string &ps)
   return ATTACK_NONE;
 }
 
-void P_IndCtrl::onFrame(int /*frameCount*/)
+PlayerView::Selection P_IndCtrl::policySelection(Policy pol)
+{
+  switch (pol) {
+
+    case ATTACK_CLOSEST:
+      return PlayerView::CLOSEST;
+      
+    case ATTACK_WEAKEST:
+      return PlayerView::WEAKEST;
+      
+    case ATTACK_MOST_DANGEROUS:
+      return PlayerView::MOST_DANGEROUS;
+
+    default:
+      break;
+  }
+
+  ERR("P_IndCtrl: policy " << policyToString(pol) << " doesn't select targets");
+}
+
+void P_IndCtrl::onFrame(int frameCount)
 {
 #if DEBUG_PRINT
   
@@ -62,58 +83,194 @@ void P_IndCtrl::onFrame(int /*frameCount*/)
   cout << endl;
 #endif
 
-  Quadtree<Unit> qtOpp;
-  bool useQt = Quadtree<Unit>::useQt(getQtEps());
+  FrameState fs;
+  fs.frame = frameCount;
   
-  if (useQt) {
+  // no opponent in range (or none visible) => only motion decisions
+  fs.attackPossible = self().isAttackPossible() && !opponent().getUnits().empty();
+  fs.useIndex = getSpatial().useIndex() && fs.attackPossible;
+  fs.indexOpp = opponent().getIndex();
+  
+  if (fs.useIndex && (!fs.indexOpp || fs.indexOpp->getType() != getSpatial().type)) {
+
+    // world doesn't maintain the one we want => build it
 
     // larger to accomodate max coordinates
-    qtOpp.setup(self().getWidth()+1, self().getHeight()+1, getQtEps());
+    // (setup clears index, but keeps its memory)
+    localIndex.setup(getSpatial(), self().getWidth()+1, self().getHeight()+1);
+    localIndex.build(opponent().getUnits());
+    fs.indexOpp = &localIndex;
+  }
+
+  // attack closest with quadtree: one pruned nearest neighbour search per
+  // unit, which stops at the closest attackable unit
+  fs.nearestSearch =
+    fs.useIndex && polEnum == ATTACK_CLOSEST && fs.indexOpp->getType() == SpatialParams::QT;
+
+  if (getThreads() > 1 && (!pool || pool->getThreads() != getThreads())) {
+    pool.reset(new ThreadPool(getThreads()));
+  }
+
+  const vector<const Unit*> &pending = self().getPendingUnits();
+  int threads = pool ? pool->getThreads() : 1;
+  workers.resize(static_cast<size_t>(threads));
+  
+  if (threads == 1 || pending.size() <= MIN_CHUNK) {
+
+    decide(fs, pending, workers[0]);
+
+  } else {
+
+    /* units are decided independently - the outcome doesn't depend on how
+       they are split into tasks; tasks are runs of units sorted by map tile,
+       so that batched queries are shared as in the single threaded case;
+       several tasks per thread let idle threads steal work
+    */
+
+    fp_t tileSize = 0;
+
+    for (const Unit *u : pending) {
+      tileSize = max(tileSize, 2 * u->attackRange);
+    }
+
+    tileSize = max(tileSize, 1.0f);
+    int tilesX = static_cast<int>(self().getWidth() / tileSize) + 1;
+    tileOrder.clear();
+
+    for (const Unit *u : pending) {
+      int tile = static_cast<int>(u->pos.y / tileSize) * tilesX + static_cast<int>(u->pos.x / tileSize);
+      tileOrder.push_back({ tile, u });
+    }
+
+    // stable: ties keep pending order
+    stable_sort(tileOrder.begin(), tileOrder.end(),
+                [](const pair<int, const Unit*> &a, const pair<int, const Unit*> &b) {
+                  return a.first < b.first;
+                });
+
+    units.clear();
+
+    for (const auto &p : tileOrder) {
+      units.push_back(p.second);
+    }
+
+    size_t n = units.size();
+    size_t chunk = max(MIN_CHUNK, (n + 8*static_cast<size_t>(threads) - 1) / (8*static_cast<size_t>(threads)));
+    int tasks = static_cast<int>((n + chunk - 1) / chunk);
+    const Unit * const *first = units.data();
 
-    for (auto &u : opponent().getUnits()) {
-      qtOpp.insert(&u);
+    pool->run(tasks, [&](int i, int thread) {
+      size_t begin = static_cast<size_t>(i) * chunk;
+      size_t end = min(begin + chunk, n);
+      decide(fs, Span<const Unit*>(first + begin, first + end), workers[static_cast<size_t>(thread)]);
+    });
+  }
+
+  // merge - the action map is keyed by unit id, so the result doesn't
+  // depend on which thread decided which unit
+  
+  for (Worker &w : workers) {
+    for (const auto &p : w.actions) {
+      self().addAction(*p.first, p.second);
     }
+    w.actions.clear();
   }
+}
+
+
+void P_IndCtrl::decide(const FrameState &fs, Span<const Unit *> units, Worker &w)
+{
+  const SpatialIndex<Unit> *indexOpp = fs.indexOpp;
   
-  for (auto &u : self().getUnits()) {
+  if (fs.useIndex && !fs.nearestSearch) {
+
+    // find targets of all units ready to attack in one batch
+
+    w.readyUnits.clear();
+
+    for (const Unit *u : units) {
+      if (u->readyForAttack() && self().isAttackPossible(*u)) {
+        w.readyUnits.push_back(u);
+      }
+    }
 
-    if (u.readyForAttack()) {
+    if (polEnum == ATTACK_NONE) {
+      self().enemiesWithinAttackRange(w.readyUnits, *indexOpp, opponent().getMaxRadius(), w.candidates);
+    } else {
+      // policy applied while filtering candidates
+      self().bestTargets(w.readyUnits, *indexOpp, opponent().getMaxRadius(), policySelection(polEnum),
+                         w.candidates);
+    }
+  }
+
+  size_t readyIndex = 0;
+  vector<int> &targetIds = w.targetIds;
+
+  // units that are moving and can't attack keep going
+  
+  for (const Unit *up : units) {
+
+    const Unit &u = *up;
+
+    if (fs.attackPossible && u.readyForAttack() && self().isAttackPossible(u)) {
 
       // ready to attack
 
-      vector<int> targetIds;
-      vector<const Unit *> attackableUnits;
+      targetIds.clear();
+
+      if (fs.nearestSearch) {
+
+        const Unit *target =
+          self().closestAttackableEnemy(u, indexOpp->getQuadtree(), opponent().getMaxRadius());
+
+        if (target) {
+          targetIds.push_back(target->unitId);
+        }
 
-      if (useQt) {
-        self().enemiesWithinAttackRange(u, qtOpp, opponent().getMaxRadius(), attackableUnits);
+      } else if (fs.useIndex && polEnum != ATTACK_NONE) {
+
+        const Unit *target = w.candidates.best[readyIndex++];
+
+        if (target) {
+          targetIds.push_back(target->unitId);
+        }
+        
       } else {
-        self().enemiesWithinAttackRange(u, opponent().getUnits(), attackableUnits);
-      }
+        
+        Span<const Unit *> attackableUnits;
 
-      // cout << "targets " << attackableUnits.size() << endl;
-      
-      switch (polEnum) {
+        if (fs.useIndex) {
+          attackableUnits = w.candidates.get(readyIndex++);
+        } else {
+          self().enemiesWithinAttackRange(u, opponent().getUnits(), w.bfUnits);
+          attackableUnits = w.bfUnits;
+        }
+
+        // cout << "targets " << attackableUnits.size() << endl;
+
+        switch (polEnum) {
 
-        case ATTACK_NONE:
-          // could be faster by skipping above code
-          // but want to measure performance of above without decimating units
-          break;
+          case ATTACK_NONE:
+            // could be faster by skipping above code
+            // but want to measure performance of above without decimating units
+            break;
         
-        case ATTACK_WEAKEST:
-          self().weakestTargetIndexes(u, attackableUnits, targetIds);
-          break;
+          case ATTACK_WEAKEST:
+            self().weakestTargetIndexes(u, attackableUnits, targetIds);
+            break;
           
-        case ATTACK_CLOSEST:
-          self().closestTargetIndexes(u, attackableUnits, targetIds);
-          break;
+          case ATTACK_CLOSEST:
+            self().closestTargetIndexes(u, attackableUnits, targetIds);
+            break;
           
-        case ATTACK_MOST_DANGEROUS:
-          self().mostDangerousTargetIndexes(u, attackableUnits, targetIds);
-          break;
+          case ATTACK_MOST_DANGEROUS:
+            self().mostDangerousTargetIndexes(u, attackableUnits, targetIds);
+            break;
           
-        default:
-          cerr << "P_IndCtrl: unknown policy" << endl;
-          exit(10);
+          default:
+            cerr << "P_IndCtrl: unknown policy" << endl;
+            exit(10);
+        }
       }
 
       // cout << targetIds.size() << endl;
@@ -127,7 +284,7 @@ void P_IndCtrl::onFrame(int /*frameCount*/)
         a.attackTargetId = targetIds[0];
 
         // generate attack action
-        self().addAction(u, a);
+        w.actions.push_back({ &u, a });
         DPRINT("player: attack " << u.unitId << " target " << a.attackTargetId);
         continue;
       }
@@ -141,8 +298,8 @@ void P_IndCtrl::onFrame(int /*frameCount*/)
 
       Action a;
       a.type = Action::MOVE;
-      a.movePos = rndEdgePos(u.radius, u.pos);
-      self().addAction(u, a);
+      a.movePos = rndEdgePos(u.radius, u.pos, fs.frame, u.unitId);
+      w.actions.push_back({ &u, a });
 
       DPRINT("player: move " << u.unitId << " to " << a.movePos);
     }
@@ -151,5 +308,5 @@ void P_IndCtrl::onFrame(int /*frameCount*/)
 
 void P_IndCtrl::onGameEnd()
 {
-  cout << "game ended" << endl;
+  DPRINT("game ended");
 }
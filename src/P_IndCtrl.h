@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Player.h"
+#include "ThreadPool.h"
+#include <memory>
 
 class P_IndCtrl : public Player
 {
@@ -8,10 +10,11 @@ public:
 
   enum Policy { ATTACK_NONE=0, ATTACK_CLOSEST, ATTACK_WEAKEST, ATTACK_MOST_DANGEROUS };
 
-  P_IndCtrl(World *world_, int playerId_, const std::string &name_, fp_t qtEps_,
+  P_IndCtrl(World *world_, int playerId_, const std::string &name_,
+            const SpatialParams &spatial_,
             const std::string &pol_, int seed_)
   {
-    setup(world_, playerId_, name_, qtEps_, pol_, seed_);
+    setup(world_, playerId_, name_, spatial_, pol_, seed_);
     polEnum = policyFromString(pol_);
   }
   
@@ -20,11 +23,45 @@ public:
 
   static Policy policyFromString(const std::string &ps);
 
-  void onFrame(int /*frameCount*/) override;
+  // batched target selection implementing policy
+  static PlayerView::Selection policySelection(Policy pol);
+
+  void onFrame(int frameCount) override;
 
   void onGameEnd() override;
 
 private:
 
+  // units per task when deciding in parallel (a task's ready units share
+  // batched range queries)
+  static constexpr size_t MIN_CHUNK = 64;
+
+  // scratch and output of one thread, reused across frames
+  struct Worker
+  {
+    std::vector<const Unit *> readyUnits;
+    AttackCandidates candidates;
+    std::vector<const Unit *> bfUnits;
+    std::vector<int> targetIds;
+    std::vector<std::pair<const Unit *, Action>> actions;
+  };
+
+  // per frame decision state (read by all workers)
+  struct FrameState
+  {
+    int frame;
+    bool attackPossible, useIndex, nearestSearch;
+    const SpatialIndex<Unit> *indexOpp;
+  };
+
   Policy polEnum;
+  SpatialIndex<Unit> localIndex; // used if world doesn't provide one, reused across frames
+
+  std::unique_ptr<ThreadPool> pool; // nullptr: single thread
+  std::vector<Worker> workers;
+  std::vector<std::pair<int, const Unit *>> tileOrder; // (tile, unit)
+  std::vector<const Unit *> units; // pending units sorted by tile
+
+  // decide actions of units (in order), appending them to w.actions
+  void decide(const FrameState &fs, Span<const Unit *> units, Worker &w);
 };
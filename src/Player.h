@@ -19,15 +19,16 @@ public:
   }
   
   void setup(World *world_, int playerId_, const std::string &name_,
-             fp_t qtEps_,
+             const SpatialParams &spatial_,
              const std::string &policy_, int seed)
   {
     world = world_;
     playerId = playerId_;
     name = name_;
-    qtEps = qtEps_;
+    spatial = spatial_;
     policy = policy_;
-    rng.seed(seed);
+    rngSeed = static_cast<uint64_t>(seed);
+    rng = KeyedRNG(rngSeed, 0, static_cast<uint64_t>(playerId), RndPurpose::PLAYER);
   }
 
   void setId(int id) { playerId = id; }
@@ -36,7 +37,15 @@ public:
   std::string getName() const { return name; }
   std::string getPolicy() const { return policy; }
 
-  fp_t getQtEps() const { return qtEps; }
+  // threads the player may use in onFrame (default 1)
+  void setThreads(int n) { threads = std::max(n, 1); }
+  int getThreads() const { return threads; }
+
+  // with auto tuning the world's current choice
+  const SpatialParams &getSpatial() const
+  {
+    return spatial.autoEps ? world->getSpatial() : spatial;
+  }
   
   PlayerView &self();
   const PlayerView &opponent() const;
@@ -49,7 +58,7 @@ public:
 
   virtual void onBorderCollision(int /*unitId*/) { }
 
-  // helpers
+  // helpers (draws from the player's stream, key: seed, player id, PLAYER)
 
   // integer [0,n)
   int rndInt(int n) const { return world->rndInt(n, rng); }
@@ -65,13 +74,30 @@ public:
   {
     return world->rndEdgePos(radius, now, rng);
   }
+
+  // same, drawn from unitRng(frame, unitId)
+  Vec2 rndEdgePos(fp_t radius, const Vec2 &now, int frame, int unitId) const
+  {
+    KeyedRNG gen = unitRng(frame, unitId);
+    return world->rndEdgePos(radius, now, gen);
+  }
+
+  // generator for the decisions of one unit in one frame: doesn't depend on
+  // the order in which units are handled, e.g. by several threads
+  KeyedRNG unitRng(int frame, int unitId) const
+  {
+    return KeyedRNG(rngSeed, static_cast<uint64_t>(frame), static_cast<uint64_t>(unitId),
+                    RndPurpose::DECISION);
+  }
   
 private:
 
   World *world;
   int playerId;
   std::string name;
-  fp_t qtEps;
+  SpatialParams spatial;
   std::string policy;
-  mutable RNG rng;
+  mutable KeyedRNG rng;
+  uint64_t rngSeed = 0;
+  int threads = 1;
 };
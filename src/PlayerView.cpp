@@ -5,15 +5,17 @@
 #include <cstdlib>
 #include <iostream>
 #include <limits>
+#include <algorithm>
 #include "World.h"
 #include "Unit.h"
+#include "RangeKernels.h"
 
 using namespace std;
 
 // populate a vector with enemy units that can be attacked by u;
 // clears vector first
 void PlayerView::enemiesWithinAttackRange(const Unit &u,
-                                          const vector<Unit> &enemyUnits,
+                                          Span<Unit> enemyUnits,
                                           vector<const Unit*> &attackableUnits) const
 {
   attackableUnits.clear();
@@ -32,41 +34,227 @@ void PlayerView::enemiesWithinAttackRange(const Unit &u,
 }
 
 
-void PlayerView::enemiesWithinAttackRange(const Unit &u,
-                                          const Quadtree<Unit> &qtOpp,
-                                          fp_t maxRadius,
-                                          std::vector<const Unit *> &attackableUnits) const
+const Unit *PlayerView::closestAttackableEnemy(const Unit &u,
+                                               const Quadtree<Unit> &qtOpp,
+                                               fp_t maxRadius) const
 {
   assert(maxRadius > 0);
-  
-  fp_t r = u.visionRange + maxRadius * 1.1f; // avoid rounding problems
-  vector<const Unit*> candidateUnits;
 
-  // cout << "enemy query " << u.unitId << endl;
+  fp_t r = u.attackRange + maxRadius * 1.1f; // avoid rounding problems
+  thread_local vector<const Unit*> closest;
+
+  qtOpp.queryNearest(u.pos.x, u.pos.y, 1, r, closest,
+                     [&u](const Unit *v) { return World::canAttack(u, *v); },
+                     [](const Unit *a, const Unit *b) { return a->unitId < b->unitId; });
+
+  return closest.empty() ? nullptr : closest[0];
+}
+
+
+/* batched queries
+
+   units are sorted by the tile their position falls in; each tile group
+   issues a single index query covering the query squares of all its units,
+   the candidates' coordinates are gathered into contiguous arrays, and each
+   unit filters those with the range kernels
+
+   per unit, the resulting attackable units are the same and in the same
+   order as with an index query of its own range (index query results keep
+   their relative order when the query rectangle grows)
+
+   onGroup(): called after gathering a group's candidates
+   onUnit(i, c): called for units[i] with the group's candidate arrays c,
+   in group order
+*/
+
+template <typename OnGroup, typename OnUnit>
+static void groupQueries(fp_t width,
+                         const vector<const Unit*> &units,
+                         const SpatialIndex<Unit> &indexOpp,
+                         fp_t maxRadius,
+                         AttackCandidates &result,
+                         OnGroup onGroup,
+                         OnUnit onUnit)
+{
+  assert(maxRadius > 0);
   
-  qtOpp.query(u.pos.x - r, u.pos.x + r, u.pos.y - r, u.pos.y + r, candidateUnits);
+  size_t n = units.size();
+  fp_t margin = maxRadius * 1.1f; // avoid rounding problems
+  fp_t maxR = 0;
   
-  attackableUnits.clear();
+  for (const Unit *u : units) {
+    maxR = std::max(maxR, u->attackRange + margin);
+  }
+
+  // tiles of half the query size: group members share most candidates
+
+  fp_t tileSize = std::max(maxR * 0.5f, 1.0f);
+  int tilesX = static_cast<int>(width / tileSize) + 1;
+  
+  auto &order = result.order;
+  order.clear();
+
+  for (size_t i=0; i < n; ++i) {
+    const Unit *u = units[i];
+    int tile = static_cast<int>(u->pos.y / tileSize) * tilesX + static_cast<int>(u->pos.x / tileSize);
+    order.push_back({ tile, static_cast<int>(i) });
+  }
 
-  for (const Unit *p : candidateUnits) {
+  sort(order.begin(), order.end());
+
+  for (size_t g=0; g < n; ) {
+
+    // group [g, h) shares tile
     
-    if (u.owner == p->owner) {
-      cout << "what?" << endl;
-      continue; // player is owner
+    size_t h = g;
+    fp_t xMin = numeric_limits<fp_t>::max(), xMax = numeric_limits<fp_t>::lowest();
+    fp_t yMin = xMin, yMax = xMax;
+    
+    for (; h < n && order[h].first == order[g].first; ++h) {
+      const Unit *u = units[static_cast<size_t>(order[h].second)];
+      fp_t r = u->attackRange + margin;
+      xMin = min(xMin, u->pos.x - r);
+      xMax = max(xMax, u->pos.x + r);
+      yMin = min(yMin, u->pos.y - r);
+      yMax = max(yMax, u->pos.y + r);
+    }
+
+    indexOpp.query(xMin, xMax, yMin, yMax, result.groupUnits);
+
+    auto &gx = result.groupX, &gy = result.groupY, &gr = result.groupR;
+    auto &gi = result.groupId;
+    gx.clear();
+    gy.clear();
+    gr.clear();
+    gi.clear();
+
+    for (const Unit *v : result.groupUnits) {
+      gx.push_back(v->pos.x);
+      gy.push_back(v->pos.y);
+      gr.push_back(v->radius);
+      gi.push_back(v->unitId);
     }
 
-    if (World::canAttack(u, *p)) {
-      attackableUnits.push_back(p);
+    result.inRange.resize(gx.size());
+    onGroup();
+
+    RangeArrays c{ gx.data(), gy.data(), gr.data(), gi.data(), gx.size() };
+    
+    for (size_t k=g; k < h; ++k) {
+      onUnit(static_cast<size_t>(order[k].second), c);
     }
+
+    g = h;
+  }
+}
+
+
+void PlayerView::enemiesWithinAttackRange(const vector<const Unit*> &units,
+                                          const SpatialIndex<Unit> &indexOpp,
+                                          fp_t maxRadius,
+                                          AttackCandidates &result) const
+{
+  size_t n = units.size();
+  auto &order = result.order;
+  auto &sortedOffsets = result.sortedOffsets;
+  auto &sortedTargets = result.sortedTargets;
+  sortedOffsets.clear();
+  sortedTargets.clear();
+  sortedOffsets.push_back(0);
+
+  groupQueries(width, units, indexOpp, maxRadius, result,
+               [] {},
+               [&](size_t i, const RangeArrays &c) {
+
+                 // same computation as World::canAttack
+                 const Unit *u = units[i];
+                 size_t m = RangeKernels::inRange(u->pos.x, u->pos.y, u->attackRange, c,
+                                                  result.inRange.data());
+                 for (size_t j=0; j < m; ++j) {
+                   sortedTargets.push_back(result.groupUnits[result.inRange[j]]);
+                 }
+                 sortedOffsets.push_back(static_cast<int>(sortedTargets.size()));
+               });
+
+  // permute to original unit order
+
+  result.offsets.resize(n+1);
+  result.offsets[0] = 0;
+
+  for (size_t k=0; k < n; ++k) {
+    size_t i = static_cast<size_t>(order[k].second);
+    result.offsets[i+1] = sortedOffsets[k+1] - sortedOffsets[k];
+  }
+
+  for (size_t i=0; i < n; ++i) {
+    result.offsets[i+1] += result.offsets[i];
+  }
+
+  result.targets.resize(sortedTargets.size());
+
+  for (size_t k=0; k < n; ++k) {
+    size_t i = static_cast<size_t>(order[k].second);
+    copy(sortedTargets.begin() + sortedOffsets[k], sortedTargets.begin() + sortedOffsets[k+1],
+         result.targets.begin() + result.offsets[i]);
   }
 }
 
 
+void PlayerView::bestTargets(const vector<const Unit*> &units,
+                             const SpatialIndex<Unit> &indexOpp,
+                             fp_t maxRadius,
+                             Selection sel,
+                             AttackCandidates &result) const
+{
+  result.best.assign(units.size(), nullptr);
+
+  groupQueries(width, units, indexOpp, maxRadius, result,
+               [&] {
+
+                 // selection keys (as in weakest/mostDangerousTargetIndexes)
+                 result.groupHp.clear();
+                 result.groupDanger.clear();
+
+                 for (const Unit *v : result.groupUnits) {
+                   if (sel == WEAKEST) {
+                     result.groupHp.push_back(v->hp);
+                   } else if (sel == MOST_DANGEROUS) {
+                     assert(v->hp > 0);
+                     result.groupDanger.push_back(
+                       (double) v->attack / (double) (v->cooldown+1) / v->hp);
+                   }
+                 }
+               },
+               [&](size_t i, const RangeArrays &c) {
+
+                 const Unit *u = units[i];
+                 fp_t x = u->pos.x, y = u->pos.y, r = u->attackRange;
+                 int j = -1;
+
+                 switch (sel) {
+                   case CLOSEST:
+                     j = RangeKernels::closest(x, y, r, c);
+                     break;
+                   case WEAKEST:
+                     j = RangeKernels::minKey(x, y, r, c, result.groupHp.data());
+                     break;
+                   case MOST_DANGEROUS:
+                     j = RangeKernels::maxKey(x, y, r, c, result.groupDanger.data());
+                     break;
+                 }
+
+                 if (j >= 0) {
+                   result.best[i] = result.groupUnits[static_cast<size_t>(j)];
+                 }
+               });
+}
+
+
 // return a random unit that can be attacked by u with minimal hp_old value,
 // or 0 if none exists
 
 void PlayerView::weakestTargetIndexes(const Unit &/*u*/,
-                                      const vector<const Unit*> &attackableUnits,
+                                      Span<const Unit*> attackableUnits,
                                       vector<int> &targetIds) const
 {
   targetIds.clear();
@@ -94,6 +282,7 @@ void PlayerView::weakestTargetIndexes(const Unit &/*u*/,
   }
 
   assert(!targetIds.empty());  
+  sort(targetIds.begin(), targetIds.end());
 }
 
 
@@ -101,7 +290,7 @@ void PlayerView::weakestTargetIndexes(const Unit &/*u*/,
 // or 0 if none exists
 
 void PlayerView::closestTargetIndexes(const Unit &u,
-                                      const vector<const Unit*> &attackableUnits,
+                                      Span<const Unit*> attackableUnits,
                                       vector<int> &targetIds) const
 {
   targetIds.clear();
@@ -129,6 +318,7 @@ void PlayerView::closestTargetIndexes(const Unit &u,
   }
 
   assert(!targetIds.empty());
+  sort(targetIds.begin(), targetIds.end());
 }
 
 
@@ -136,7 +326,7 @@ void PlayerView::closestTargetIndexes(const Unit &u,
 // ratio, or 0 if none exists
 
 void PlayerView::mostDangerousTargetIndexes(const Unit &/*u*/,
-                                      const vector<const Unit*> &attackableUnits,
+                                      Span<const Unit*> attackableUnits,
                                       vector<int> &targetIds) const
 {
   targetIds.clear();
@@ -166,5 +356,6 @@ void PlayerView::mostDangerousTargetIndexes(const Unit &/*u*/,
   }
   
   assert(!targetIds.empty());
+  sort(targetIds.begin(), targetIds.end());
 }
 
@@ -6,10 +6,38 @@
 
 #include "Unit.h"
 #include "Action.h"
-#include "Quadtree.h"
+#include "SpatialIndex.h"
 #include <vector>
 #include <map>
 
+// attack candidates of many units in CSR form:
+// targets of unit i are targets[offsets[i] .. offsets[i+1])
+struct AttackCandidates
+{
+  std::vector<int> offsets;
+  std::vector<const Unit*> targets;
+
+  Span<const Unit*> get(size_t i) const
+  {
+    const Unit *const *first = targets.data();
+    return Span<const Unit*>(first + offsets[i], first + offsets[i+1]);
+  }
+
+  // bestTargets result: one target per unit, nullptr if none
+  std::vector<const Unit*> best;
+
+  // scratch space (kept to avoid allocations)
+  std::vector<std::pair<int, int>> order;   // (tile, unit index)
+  std::vector<const Unit*> groupUnits;      // index query result of group
+  std::vector<fp_t> groupX, groupY, groupR; // their coordinates and radii
+  std::vector<int> groupId;                 // and unitIds
+  std::vector<int> groupHp;                 // selection keys
+  std::vector<double> groupDanger;
+  std::vector<uint32_t> inRange;            // kernel output
+  std::vector<int> sortedOffsets;           // CSR in group order
+  std::vector<const Unit*> sortedTargets;
+};
+
 class PlayerView
 {
 public:
@@ -18,37 +46,91 @@ public:
 
   std::string getName() const { return std::string("player") + std::to_string(playerId); }
 
-  const std::vector<Unit> &getUnits() const { return units; }
+  // read-only; valid until the end of the current frame
+  Span<Unit> getUnits() const { return units; }
 
   fp_t getHeight() const { return height; }
   fp_t getWidth() const { return width; }
   
   fp_t getMaxRadius() const { return maxRadius; }
 
+  // spatial index over getUnits() maintained by world, nullptr if not available
+  const SpatialIndex<Unit> *getIndex() const { return index; }
+
+  // false if world knows that no unit is within attack range of an opponent
+  // unit in this frame (kinetic ranges), i.e. range queries can be skipped
+  bool isAttackPossible() const { return attackPossible; }
+
+  // same for a single unit (of either player)
+  bool isAttackPossible(const Unit &u) const
+  {
+    return !inRangeCounts || (*inRangeCounts)[static_cast<size_t>(u.unitId)] > 0;
+  }
+
+  // own units that became ready to attack / idle (stopped) in this frame
+  // and all that are ready or idle - the ones a player has to decide on;
+  // in view order
+  const std::vector<const Unit*> &getBecameReady() const { return becameReady; }
+  const std::vector<const Unit*> &getBecameIdle() const { return becameIdle; }
+  const std::vector<const Unit*> &getPendingUnits() const { return pendingUnits; }
+
   void addAction(const Unit &actor, const Action &action)
   {
     actions.insert({ actor.unitId, action });
   }
 
-  void enemiesWithinAttackRange(const Unit &u,
-                                const std::vector<Unit> &enemyUnits,
-                                std::vector<const Unit *> &attackableUnits) const;
+  // same by id (actions of dead units are skipped by World)
+  void addAction(int unitId, const Action &action)
+  {
+    actions.insert({ unitId, action });
+  }
+
+  // actions added in this frame (kept until the next frame's views are
+  // computed, e.g. for recording them)
+  const std::map<int, Action> &getActions() const { return actions; }
 
   void enemiesWithinAttackRange(const Unit &u,
-                                const Quadtree<Unit> &qtOpp,
-                                fp_t maxRadius,
+                                Span<Unit> enemyUnits,
                                 std::vector<const Unit *> &attackableUnits) const;
 
+  // batched version for many units: nearby units share one index query
+  void enemiesWithinAttackRange(const std::vector<const Unit *> &units,
+                                const SpatialIndex<Unit> &indexOpp,
+                                fp_t maxRadius,
+                                AttackCandidates &result) const;
+
+  // target selection of bestTargets
+  enum Selection { CLOSEST, WEAKEST, MOST_DANGEROUS };
+
+  // target of each unit (=> result.best): the attackable unit with minimal
+  // distance, minimal hp, or maximal danger, ties broken by lowest unitId -
+  // the unit the matching *TargetIndexes function reports first; candidates
+  // are filtered and selected in one pass
+  void bestTargets(const std::vector<const Unit *> &units,
+                   const SpatialIndex<Unit> &indexOpp,
+                   fp_t maxRadius,
+                   Selection sel,
+                   AttackCandidates &result) const;
+
+  // closest enemy u can attack (ties: lowest unitId, as in bestTargets),
+  // nullptr if none; one best-first search which stops at the first
+  // attackable unit
+  const Unit *closestAttackableEnemy(const Unit &u,
+                                     const Quadtree<Unit> &qtOpp,
+                                     fp_t maxRadius) const;
+
+  // ids of all optimal targets (increasing, so the first one doesn't depend
+  // on the order of attackableUnits)
   void closestTargetIndexes(const Unit &u,
-                            const std::vector<const Unit *> &attackableUnits,
+                            Span<const Unit *> attackableUnits,
                             std::vector<int> &targetIds) const;
 
   void weakestTargetIndexes(const Unit &u,
-                            const std::vector<const Unit *> &attackableUnits,
+                            Span<const Unit *> attackableUnits,
                             std::vector<int> &targetIds) const;
 
   void mostDangerousTargetIndexes(const Unit &u,
-                                  const std::vector<const Unit *> &attackableUnits,
+                                  Span<const Unit *> attackableUnits,
                                   std::vector<int> &targetIds) const;
 private:
 
@@ -56,29 +138,46 @@ private:
 
   fp_t width, height;
   bool fogOfWar;
-  fp_t qtEps;
   int playerId;
-  std::vector<Unit> units;
+  Span<Unit> units;               // points into world storage or visibleUnits
+  std::vector<Unit> visibleUnits; // copies of visible units (fog of war)
   fp_t maxRadius; // of all units (for quadtree queries)
+  const SpatialIndex<Unit> *index;
+  bool attackPossible;
+  const std::vector<int> *inRangeCounts; // by unit id, nullptr: unknown
+  std::vector<const Unit*> becameReady, becameIdle, pendingUnits; // self view
   std::map<int, Action> actions; // unit id -> action
 
   // called by world
   
-  void setup(int playerId_, fp_t width_, fp_t height_, bool fogOfWar_, fp_t qtEps_)
+  void setup(int playerId_, fp_t width_, fp_t height_, bool fogOfWar_)
   {
     playerId = playerId_;
     width = width_;
     height = height_;
     fogOfWar = fogOfWar_;
-    qtEps = qtEps_;
-    units.clear();
+    units = Span<Unit>();
+    visibleUnits.clear();
     maxRadius = 0;
+    index = nullptr;
+    attackPossible = true;
+    inRangeCounts = nullptr;
     actions.clear();
   }
 
+  // view units directly in world storage
+  void setUnits(Span<Unit> units_, fp_t maxRadius_, const SpatialIndex<Unit> *index_)
+  {
+    units = units_;
+    maxRadius = maxRadius_;
+    index = index_;
+  }
+  
+  // add copy of unit (used when only a subset is visible)
   void addUnit(const Unit &u)
   {
-    units.push_back(u);
+    visibleUnits.push_back(u);
+    units = Span<Unit>(visibleUnits);
     maxRadius = std::max(maxRadius, u.radius);
   }
 
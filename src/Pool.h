@@ -0,0 +1,73 @@
+#pragma once
+
+// object pool
+//
+// hands out T objects from fixed-size blocks which are only released when
+// the pool is destroyed; free() puts objects on a free list, reset()
+// recycles all objects in O(1) while keeping the capacity
+// objects are not reconstructed when handed out again - callers
+// reinitialize them (which lets them keep their own buffers)
+
+#include "Global.h"
+#include <memory>
+#include <vector>
+
+template <typename T, size_t BlockSize = 256>
+class Pool
+{
+public:
+
+  Pool()
+    : used(0), allocs(0)
+  {
+  }
+
+  T *alloc()
+  {
+    if (!freeList.empty()) {
+      T *p = freeList.back();
+      freeList.pop_back();
+      return p;
+    }
+
+    if (used == blocks.size() * BlockSize) {
+      blocks.emplace_back(new T[BlockSize]);
+      ++allocs;
+    }
+
+    T *p = &blocks[used / BlockSize][used % BlockSize];
+    ++used;
+    return p;
+  }
+
+  void free(T *p)
+  {
+    if (freeList.size() == freeList.capacity()) {
+      ++allocs;
+    }
+    freeList.push_back(p);
+  }
+
+  // all objects become available again
+  void reset()
+  {
+    used = 0;
+    freeList.clear();
+  }
+
+  // objects handed out and not freed
+  size_t size() const { return used - freeList.size(); }
+
+  // objects owned by pool
+  size_t capacity() const { return blocks.size() * BlockSize; }
+
+  // number of heap allocations since construction
+  size_t getAllocs() const { return allocs; }
+
+private:
+
+  std::vector<std::unique_ptr<T[]>> blocks;
+  std::vector<T*> freeList;
+  size_t used;   // objects taken from blocks
+  size_t allocs;
+};
@@ -2,6 +2,8 @@
 
 #include "Global.h"
 #include "Quadtree.h"
+#include "LinearQuadtree.h"
+#include "Grid.h"
 #include <vector>
 #include <algorithm>
 
@@ -12,6 +14,7 @@ using Coor = double;
 struct Point
 {
   Coor x, y;
+  int id = 0; // tie order of nearest search check
 
   Coor getX() const { return x; }
   Coor getY() const { return y; }
@@ -37,22 +40,135 @@ static double rnd01(RNG &rng)
   return r;
 }
 
+static void slow_circle(Coor x, Coor y, Coor r,
+                        const vector<Point> &points,
+                        const vector<bool> &alive,
+                        vector<const Point*> &hits)
+{
+  hits.clear();
+  
+  for (size_t i=0; i < points.size(); ++i) {
+    const Point &p = points[i];
+    if (alive[i] && square(p.x - x) + square(p.y - y) < r*r) {
+      hits.push_back(&p);
+    }
+  }
+}
+
 static void slow_query(Coor xMin, Coor xMax, Coor yMin, Coor yMax,
                 const vector<Point> &points,
+                const vector<bool> &alive,
                 vector<const Point*> &hits)
 {
   hits.clear();
   
-  for (auto &p : points) {
-    if (p.x >= xMin && p.x < xMax && p.y >= yMin && p.y < yMax) {
+  for (size_t i=0; i < points.size(); ++i) {
+    const Point &p = points[i];
+    if (alive[i] && p.x >= xMin && p.x < xMax && p.y >= yMin && p.y < yMax) {
       hits.push_back(&p);
     }
   }
 }
 
 
+/* k-nearest queries with many equal distances: points on a small integer
+   lattice (with duplicates), ties ordered by id instead of address; before
+   and after moving / removing points
+*/
+
+static void nearestTiesTest(RNG &rng)
+{
+  constexpr int N = 1'000; // point sets
+  constexpr int M = 200;   // points
+  constexpr int Q = 200;   // queries
+  constexpr int W = 20;
+  constexpr int H = 10;
+
+  auto rndInt = [&](int n) { return static_cast<int>(rng() % static_cast<unsigned>(n)); };
+  auto idLess = [](const Point *a, const Point *b) { return a->id < b->id; };
+
+  for (int i=0; i < N; ++i) {
+
+    Quadtree<Point> qt;
+    vector<Point> points(M);
+    vector<bool> alive(M, true);
+
+    qt.setup(W+1, H+1, 1);
+    rng.seed(i);
+
+    // ids in random order, so address order doesn't help
+    for (int j=0; j < M; ++j) {
+      points[j] = { Coor(rndInt(W)), Coor(rndInt(H)), j };
+    }
+    for (int j=M; j > 1; --j) {
+      swap(points[j-1].id, points[rndInt(j)].id);
+    }
+    for (auto &p : points) {
+      qt.insert(&p);
+    }
+
+    for (int round=0; round < 2; ++round) {
+
+      if (round > 0) {
+        for (int j=0; j < M; ++j) {
+          Point &p = points[j];
+          if (j % 5 == 0) {
+            if (!qt.remove(&p)) {
+              ERR("quadtree ties test: remove failed " << i << " " << j);
+            }
+            alive[j] = false;
+            continue;
+          }
+          Coor oldX = p.x, oldY = p.y;
+          p.x = Coor(rndInt(W));
+          p.y = Coor(rndInt(H));
+          if (!qt.update(&p, oldX, oldY)) {
+            ERR("quadtree ties test: update failed " << i << " " << j);
+          }
+        }
+      }
+
+      vector<const Point*> hitsSlow, hitsQt;
+
+      for (int j=0; j < Q; ++j) {
+
+        Coor x = Coor(rndInt(W)), y = Coor(rndInt(H));
+        Coor r = Coor(1 + rndInt(W/2));
+        size_t k = static_cast<size_t>(1 + rndInt(8));
+
+        slow_circle(x, y, r, points, alive, hitsSlow);
+        sort(begin(hitsSlow), end(hitsSlow), [&](const Point *a, const Point *b) {
+          Coor da = square(a->x - x) + square(a->y - y);
+          Coor db = square(b->x - x) + square(b->y - y);
+          return da < db || (da == db && a->id < b->id);
+        });
+        if (hitsSlow.size() > k) {
+          hitsSlow.resize(k);
+        }
+
+        qt.queryNearest(x, y, k, r, hitsQt, [](const Point *) { return true; }, idLess);
+
+        if (hitsSlow != hitsQt) {
+          cout << "test " << i << " " << j << " failed" << endl;
+          ERR("quadtree ties test: different nearest points "
+              << hitsSlow.size() << " " << hitsQt.size());
+        }
+      }
+    }
+  }
+}
+
+
 /* create random point set and query instances, and compare QT results with
    brute-force computation results
+
+   in a second round points are moved (update) or removed, and queries are
+   checked again
+
+   circle and k-nearest queries are checked the same way, and range and
+   circle queries of a LinearQuadtree built over the same points and of a
+   Grid updated along with the quadtree; finally k-nearest queries with
+   ties (nearestTiesTest)
 */
    
 void quadtreeTest()
@@ -72,9 +188,14 @@ void quadtreeTest()
     cout << "." << flush; 
     
     Quadtree<Point> qt;
+    LinearQuadtree<Point> lqt;
+    Grid<Point> grid;
     vector<Point> points;
+    vector<bool> alive(M, true);
     
     qt.setup(W+1, H+1, 1);
+    lqt.setup(W+1, H+1);
+    grid.setup(W+1, H+1, W/8);
 
     rng.seed(i);
     
@@ -86,68 +207,205 @@ void quadtreeTest()
     // 2nd loop to ensure p addresses won't change
     for (auto &p : points) {
       qt.insert(&p);
+      grid.insert(&p);
     }
     
-    for (int j=0; j < Q; ++j) {
+    for (int round=0; round < 2; ++round) {
+
+      if (round > 0) {
+
+        // move or remove points
 
-      // cout << "test " << i << " " << j << endl;
+        rng.seed(i);
 
-      // for debugging testing single instance
-      // can also set i and j to specific values
-      // because rng seeds just depends on them
-      bool dbg = false; // (i == 5 && j == 5);
+        for (int j=0; j < M; ++j) {
 
-      if (dbg) {
-        cout << "XXXXXXXXXXXXXXXXXXXXXXXXXXXXX" << endl;
+          Point &p = points[j];
+        
+          if (j % 5 == 0) {
+            if (!qt.remove(&p)) {
+              ERR("quadtree test: remove failed " << i << " " << j);
+            }
+            if (!grid.remove(&p)) {
+              ERR("quadtree test: grid remove failed " << i << " " << j);
+            }
+            alive[j] = false;
+            continue;
+          }
+        
+          Coor oldX = p.x, oldY = p.y;
+          p.x = min(max(p.x + (rnd01(rng) - 0.5) * W * 0.1, 0.0), W);
+          p.y = min(max(p.y + (rnd01(rng) - 0.5) * H * 0.1, 0.0), H);
+        
+          if (!qt.update(&p, oldX, oldY)) {
+            ERR("quadtree test: update failed " << i << " " << j);
+          }
+          if (!grid.update(&p, oldX, oldY)) {
+            ERR("quadtree test: grid update failed " << i << " " << j);
+          }
+        }
+      }
+
+      lqt.clear();
+      for (int j=0; j < M; ++j) {
+        if (alive[j]) {
+          lqt.insert(&points[j]);
+        }
       }
+      lqt.build();
+    
+      for (int j=0; j < Q; ++j) {
+
+        // cout << "test " << i << " " << j << endl;
+
+        // for debugging testing single instance
+        // can also set i and j to specific values
+        // because rng seeds just depends on them
+        bool dbg = false; // (i == 5 && j == 5);
+
+        if (dbg) {
+          cout << "XXXXXXXXXXXXXXXXXXXXXXXXXXXXX" << endl;
+        }
       
-      rng.seed(j);
+        rng.seed(j);
       
-      Coor xMin = rnd01(rng) * W;
-      Coor xMax = xMin + (rnd01(rng) + 0.1) * W;
-      Coor yMin = rnd01(rng) * H;
-      Coor yMax = yMin + (rnd01(rng) + 0.1) * H;
+        Coor xMin = rnd01(rng) * W;
+        Coor xMax = xMin + (rnd01(rng) + 0.1) * W;
+        Coor yMin = rnd01(rng) * H;
+        Coor yMax = yMin + (rnd01(rng) + 0.1) * H;
 
-      if (dbg) {
-        for (auto &p : points) {
-          cout << p << endl;
+        if (dbg) {
+          for (auto &p : points) {
+            cout << p << endl;
+          }
+          cout << xMin << " " << xMax << " " << yMin << " " << yMax << endl;
         }
-        cout << xMin << " " << xMax << " " << yMin << " " << yMax << endl;
-      }
       
-      vector<const Point*> hitsSlow;
-      slow_query(xMin, xMax, yMin, yMax, points, hitsSlow);
+        vector<const Point*> hitsSlow;
+        slow_query(xMin, xMax, yMin, yMax, points, alive, hitsSlow);
 
-      vector<const Point*> hitsQt;
-      qt.query(xMin, xMax, yMin, yMax, hitsQt);
+        vector<const Point*> hitsQt;
+        qt.query(xMin, xMax, yMin, yMax, hitsQt);
 
-      auto ppComp = [](const Point *a, const Point *b) { return *a < *b; };
+        auto ppComp = [](const Point *a, const Point *b) { return *a < *b; };
       
-      sort(begin(hitsSlow), end(hitsSlow), ppComp);
-      sort(begin(hitsQt), end(hitsQt), ppComp);
+        sort(begin(hitsSlow), end(hitsSlow), ppComp);
+        sort(begin(hitsQt), end(hitsQt), ppComp);
+
+        if (dbg) {
+          for (auto &p : hitsSlow) {
+            cout << "slow: " << *p << endl;
+          }
+          for (auto &p : hitsQt) {
+            cout << "qt:   " << *p << endl;
+          }
+        }
 
-      if (dbg) {
-        for (auto &p : hitsSlow) {
-          cout << "slow: " << *p << endl;
+        if (hitsSlow.size() != hitsQt.size()) {
+          cout << "test " << i << " " << j << " failed" << endl;
+          ERR("quadtree test: different hit sizes "
+              << hitsSlow.size() << " " << hitsQt.size());
         }
-        for (auto &p : hitsQt) {
-          cout << "qt:   " << *p << endl;
+
+        for (int i=0; i < (int)hitsSlow.size(); ++i) {
+          if (hitsSlow[i]->x != hitsQt[i]->x ||
+              hitsSlow[i]->y != hitsQt[i]->y) {
+            cout << "test " << i << " " << j << " failed" << endl;
+            ERR("quadtree test: different points");
+          }
         }
-      }
 
-      if (hitsSlow.size() != hitsQt.size()) {
-        cout << "test " << i << " " << j << " failed" << endl;
-        ERR("quadtree test: different hit sizes "
-            << hitsSlow.size() << " " << hitsQt.size());
-      }
+        // same points (as addresses) from linear quadtree
+
+        vector<const Point*> hitsLqt;
+        lqt.query(xMin, xMax, yMin, yMax, hitsLqt);
+
+        sort(begin(hitsSlow), end(hitsSlow));
+        sort(begin(hitsLqt), end(hitsLqt));
+
+        if (hitsSlow != hitsLqt) {
+          cout << "test " << i << " " << j << " failed" << endl;
+          ERR("quadtree test: different linear quadtree hits "
+              << hitsSlow.size() << " " << hitsLqt.size());
+        }
+
+        // and from grid
+
+        vector<const Point*> hitsGrid;
+        grid.query(xMin, xMax, yMin, yMax, hitsGrid);
+        sort(begin(hitsGrid), end(hitsGrid));
+
+        if (hitsSlow != hitsGrid) {
+          cout << "test " << i << " " << j << " failed" << endl;
+          ERR("quadtree test: different grid hits "
+              << hitsSlow.size() << " " << hitsGrid.size());
+        }
+
+        if (grid.any(xMin, xMax, yMin, yMax, [](const Point *) { return true; }) !=
+            !hitsSlow.empty()) {
+          cout << "test " << i << " " << j << " failed" << endl;
+          ERR("quadtree test: grid any() wrong");
+        }
+
+        // circle around (xMin, yMin)
+
+        Coor r = (rnd01(rng) + 0.05) * W * 0.3;
+
+        slow_circle(xMin, yMin, r, points, alive, hitsSlow);
+        qt.queryCircle(xMin, yMin, r, hitsQt);
+
+        // by address: clamped points can coincide
+        sort(begin(hitsSlow), end(hitsSlow));
+        sort(begin(hitsQt), end(hitsQt));
+
+        if (hitsSlow != hitsQt) {
+          cout << "test " << i << " " << j << " failed" << endl;
+          ERR("quadtree test: different circle hits "
+              << hitsSlow.size() << " " << hitsQt.size());
+        }
 
-      for (int i=0; i < (int)hitsSlow.size(); ++i) {
-        if (hitsSlow[i]->x != hitsQt[i]->x ||
-            hitsSlow[i]->y != hitsQt[i]->y) {
+        lqt.queryCircle(xMin, yMin, r, hitsLqt);
+        sort(begin(hitsLqt), end(hitsLqt));
+
+        if (hitsSlow != hitsLqt) {
+          cout << "test " << i << " " << j << " failed" << endl;
+          ERR("quadtree test: different linear quadtree circle hits "
+              << hitsSlow.size() << " " << hitsLqt.size());
+        }
+
+        grid.queryCircle(xMin, yMin, r, hitsGrid);
+        sort(begin(hitsGrid), end(hitsGrid));
+
+        if (hitsSlow != hitsGrid) {
+          cout << "test " << i << " " << j << " failed" << endl;
+          ERR("quadtree test: different grid circle hits "
+              << hitsSlow.size() << " " << hitsGrid.size());
+        }
+
+        // k nearest within circle: order by distance, then address
+
+        constexpr size_t K = 5;
+        
+        auto nearComp = [&](const Point *a, const Point *b) {
+          Coor da = square(a->x - xMin) + square(a->y - yMin);
+          Coor db = square(b->x - xMin) + square(b->y - yMin);
+          return da < db || (da == db && a < b);
+        };
+        
+        sort(begin(hitsSlow), end(hitsSlow), nearComp);
+        if (hitsSlow.size() > K) {
+          hitsSlow.resize(K);
+        }
+        qt.queryNearest(xMin, yMin, K, r, hitsQt);
+
+        if (hitsSlow != hitsQt) {
           cout << "test " << i << " " << j << " failed" << endl;
-          ERR("quadtree test: different points");
+          ERR("quadtree test: different nearest points "
+              << hitsSlow.size() << " " << hitsQt.size());
         }
       }
     }
   }
+
+  nearestTiesTest(rng);
 }
@@ -5,7 +5,12 @@
 // requires Point to implement Coor getX(), Coor getY()
 
 #include "Global.h"
+#include "Pool.h"
 #include <array>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <utility>
 
 #define DEBUG_QT 0
 
@@ -34,8 +39,8 @@ class Quadtree
 {
 public:
 
-  using Coor = decltype(((Point*)nullptr)->getX());
-  static_assert(std::is_same<Coor, decltype(((Point*)nullptr)->getY())>(),
+  using Coor = decltype(std::declval<const Point&>().getX());
+  static_assert(std::is_same<Coor, decltype(std::declval<const Point&>().getY())>(),
                 "getX/getY don't match");
 
   using Rect = Rectangle1<Coor>;
@@ -59,20 +64,29 @@ private:
     if (y >= r.yMax) { return false; }
     return true;
   }
+
+  // squared distance of (x, y) to closest point in r (0 if inside)
+  static Coor minDist2(Coor x, Coor y, const Rect &r)
+  {
+    Coor dx = std::max(std::max(r.xMin - x, x - r.xMax), static_cast<Coor>(0));
+    Coor dy = std::max(std::max(r.yMin - y, y - r.yMax), static_cast<Coor>(0));
+    return dx*dx + dy*dy;
+  }
+
+  static Coor dist2(Coor x, Coor y, const Point *p)
+  {
+    return square(x - p->getX()) + square(y - p->getY());
+  }
   
+  // nodes are pooled and reused after clear(); leafPoints keeps its
+  // capacity, so rebuilding a similar tree doesn't allocate
   struct Node
   {
-    Node(const Rect &rect_)
-      : rect(rect_)
+    void init(const Rect &rect_)
     {
+      rect = rect_;
       children = { nullptr, };
-    }
-
-    ~Node()
-    {
-      for (auto p: children) {
-        delete p;
-      }
+      leafPoints.clear();
     }
 
     bool isLeaf() const
@@ -96,18 +110,17 @@ public:
     width = height = 0;
     eps = 1;
     root = nullptr;
+    allocs = leafAllocs = 0;
   }
 
-  ~Quadtree()
-  {
-    clear();
-    delete root;
-  }
-
+  // remove all points; O(1) (apart from the pool's free list), node memory
+  // is kept for reuse
   void clear()
   {
-    delete root;
-    root = new Node({ 0, width, 0, height });
+    pool.reset();
+    allocs = pool.getAllocs();
+    leafAllocs = 0;
+    root = newNode({ 0, width, 0, height });
   }
   
   void setup(Coor width_, Coor height_, Coor eps_)
@@ -116,7 +129,20 @@ public:
     width = width_;
     height = height_;
     eps = eps_;
-    root = new Node({ 0, width, 0, height });
+    clear();
+  }
+
+  // number of heap allocations since last clear()
+  // (0 in steady state when rebuilding trees of similar shape)
+  size_t getAllocs() const { return pool.getAllocs() - allocs + leafAllocs; }
+
+  // number of nodes in use
+  size_t getNodeCount() const { return pool.size(); }
+
+  // memory footprint: node pool plus point buffers of leaves in use
+  size_t getBytes() const
+  {
+    return pool.capacity() * sizeof(Node) + leafBytes(root);
   }
 
   static bool useQt(Coor eps) { return eps > 0; }
@@ -160,9 +186,7 @@ public:
     if (!node->isLeaf()) {
 
       // recurse
-      int dx = newP->getX() >= node->children[1]->rect.xMin; // SE
-      int dy = newP->getY() >= node->children[2]->rect.yMin; // NW
-      insert(node->children[dy*2+dx], newP);
+      insert(child(node, newP->getX(), newP->getY()), newP);
       return;
     }
 
@@ -171,22 +195,40 @@ public:
     if (node->leafPoints.empty()) {
 
       // first point
-      node->leafPoints.push_back(newP);
+      addLeafPoint(node, newP);
       node->pointsBB = { newP->getX(), newP->getX(), newP->getY(), newP->getY() };
       return;
     }
 
-    // update bounding box
-    
-    Rect &newBB(node->pointsBB);
-    newBB.xMin = std::min(newP->getX(), newBB.xMin);
-    newBB.xMax = std::max(newP->getX(), newBB.xMax);
-    newBB.yMin = std::min(newP->getY(), newBB.yMin);
-    newBB.yMax = std::max(newP->getY(), newBB.yMax);
-
     // add new point
     
-    node->leafPoints.push_back(newP);
+    addLeafPoint(node, newP);
+    addToBB(node, newP);
+  }
+
+  Node *newNode(const Rect &rect)
+  {
+    Node *node = pool.alloc();
+    node->init(rect);
+    return node;
+  }
+  
+  void addLeafPoint(Node *node, const Point *p)
+  {
+    if (node->leafPoints.size() == node->leafPoints.capacity()) {
+      ++leafAllocs;
+    }
+    node->leafPoints.push_back(p);
+  }
+
+  // update leaf bounding box with p and split if it gets too large
+  void addToBB(Node *node, const Point *p)
+  {
+    Rect &newBB(node->pointsBB);
+    newBB.xMin = std::min(p->getX(), newBB.xMin);
+    newBB.xMax = std::max(p->getX(), newBB.xMax);
+    newBB.yMin = std::min(p->getY(), newBB.yMin);
+    newBB.yMax = std::max(p->getY(), newBB.yMax);
 
     // all points in eps-square => done
 
@@ -228,7 +270,7 @@ public:
     // create children
     
     for (int i=0; i < 4; ++i) {
-      node->children[i] = new Node(quarters[i]);
+      node->children[i] = newNode(quarters[i]);
     }
 
     // push all points down
@@ -241,57 +283,168 @@ public:
 
     node->leafPoints.clear();
   }
+
+  // child of inner node containing (x, y)
+  static Node *child(const Node *node, Coor x, Coor y)
+  {
+    int dx = x >= node->children[1]->rect.xMin; // SE
+    int dy = y >= node->children[2]->rect.yMin; // NW
+    return node->children[dy*2+dx];
+  }
+  
+  // leaf containing (x, y)
+  Node *findLeaf(Coor x, Coor y) const
+  {
+    Node *node = root;
+
+    while (!node->isLeaf()) {
+      node = child(node, x, y);
+    }
+    return node;
+  }
   
+  // remove point pp which is stored at location (x, y)
+  // (its current coordinates unless it has been moved)
+  // @return true if found
   bool remove(const Point *pp)
   {
-    ERR("remove not tested");
-    
-    return remove(root, pp);
+    return remove(root, pp, pp->getX(), pp->getY());
   }
 
-  bool remove(Node *node, const Point *pp)
+  bool remove(Node *node, const Point *pp, Coor x, Coor y)
   {
-    if (node->containsPoints()) {
+    if (node->isLeaf()) {
 
       // search and remove point
+
+      auto &points = node->leafPoints;
+      auto it = std::find(points.begin(), points.end(), pp);
+
+      if (it == points.end()) {
+        return false;
+      }
+
+      *it = points.back();
+      points.pop_back();
+
+      // shrink bounding box
       
-      for (auto &oldP : node->leafPoints) {
-        if (*pp == *oldP) {
-          // found: erase
-          // todo: how about bounding box - may be invalid ...
-          node->leafPoints.erase(&pp);
-          return true;
-        }
+      if (!points.empty()) {
+        computeBB(node);
       }
+      return true;
+    }
 
-      // not found;
+    if (!remove(child(node, x, y), pp, x, y)) {
       return false;
     }
 
-    if (node->isLeaf()) {
-      // empty leaf => not found
-      return false;
+    merge(node);
+    return true;
+  }
+
+  // bounding box of non-empty leaf from its points' current coordinates
+  void computeBB(Node *node)
+  {
+    const auto &points = node->leafPoints;
+    const Point *p0 = points[0];
+    Rect &bb(node->pointsBB);
+    bb = { p0->getX(), p0->getX(), p0->getY(), p0->getY() };
+    for (auto p : points) {
+      bb.xMin = std::min(p->getX(), bb.xMin);
+      bb.xMax = std::max(p->getX(), bb.xMax);
+      bb.yMin = std::min(p->getY(), bb.yMin);
+      bb.yMax = std::max(p->getY(), bb.yMax);
     }
+  }
 
-    int dx = pp->getX() >= node->children[1]->rect.xMin;
-    int dy = pp->getY() >= node->children[2]->rect.yMin;
+  // replace children by a single leaf if they are leaves and their points
+  // would not have caused a split
+  void merge(Node *node)
+  {
+    bool empty = true;
+    Rect bb{ 0, 0, 0, 0 };
     
-    if (!remove(node->children[dy*2+dx], pp)) {
-      return false;
+    for (auto p : node->children) {
+
+      if (!p->isLeaf()) {
+        return;
+      }
+
+      if (p->leafPoints.empty()) {
+        continue;
+      }
+
+      if (empty) {
+        bb = p->pointsBB;
+        empty = false;
+      } else {
+        bb.xMin = std::min(p->pointsBB.xMin, bb.xMin);
+        bb.xMax = std::max(p->pointsBB.xMax, bb.xMax);
+        bb.yMin = std::min(p->pointsBB.yMin, bb.yMin);
+        bb.yMax = std::max(p->pointsBB.yMax, bb.yMax);
+      }
+    }
+
+    if (!empty && (bb.xMax - bb.xMin > eps || bb.yMax - bb.yMin > eps)) {
+      return;
     }
 
-    // remove children if they contain no points
+    for (auto &p : node->children) {
+      for (auto pp : p->leafPoints) {
+        addLeafPoint(node, pp);
+      }
+      pool.free(p);
+      p = nullptr;
+    }
+
+    node->pointsBB = bb;
+  }
+
+  // point pp has moved from (oldX, oldY) to its current coordinates
+  // if it is still in the same leaf, only the leaf's bounding box is updated
+  // (recomputed if the old position was on its border, so the box doesn't
+  // keep covering past positions), otherwise it is reinserted
+  // @return false if point was not found at old location
+  bool update(const Point *pp, Coor oldX, Coor oldY)
+  {
+    Node *leaf = findLeaf(oldX, oldY);
+
+    if (inside(pp->getX(), pp->getY(), leaf->rect)) {
+
+      assert(std::find(leaf->leafPoints.begin(), leaf->leafPoints.end(), pp) !=
+             leaf->leafPoints.end());
+
+      const Rect &bb = leaf->pointsBB;
+      if (oldX == bb.xMin || oldX == bb.xMax || oldY == bb.yMin || oldY == bb.yMax) {
+        computeBB(leaf);
+      }
+      addToBB(leaf, pp); // split test
+      return true;
+    }
+
+    // changed cell
     
-    if (node->children[0]->isEmptyLeaf() &&
-        node->children[1]->isEmptyLeaf() &&
-        node->children[2]->isEmptyLeaf() &&
-        node->children[3]->isEmptyLeaf()) {
+    if (!remove(root, pp, oldX, oldY)) {
+      return false;
+    }
 
-      for (auto p: node->children) {
-        delete p;
-      }      
+    insert(root, pp);
+    return true;
+  }
+
+  // point data moved from address oldP to newP (same coordinates)
+  // @return false if oldP was not found
+  bool rebind(const Point *oldP, const Point *newP)
+  {
+    auto &points = findLeaf(newP->getX(), newP->getY())->leafPoints;
+    auto it = std::find(points.begin(), points.end(), oldP);
+
+    if (it == points.end()) {
+      return false;
     }
 
+    *it = newP;
     return true;
   }
 
@@ -338,13 +491,178 @@ public:
     }
   }
 
+  // @return true if f(p) is true for a point p in [xMin, xMax) x [yMin, yMax)
+  // (stops at first hit)
+  template <typename F>
+  bool any(Coor xMin, Coor xMax, Coor yMin, Coor yMax, F f) const
+  {
+    return any(root, Rect{ xMin, xMax, yMin, yMax }, f);
+  }
+
+  template <typename F>
+  bool any(Node *node, const Rect &rect, F &f) const
+  {
+    if (!intersect(node->rect, rect)) {
+      return false;
+    }
+    
+    if (!node->leafPoints.empty()) {
+      for (const auto p : node->leafPoints) {
+        if (inside(p->getX(), p->getY(), rect) && f(p)) {
+          return true;
+        }
+      }      
+      return false;
+    }
+
+    for (Node *p : node->children) {
+      if (p && any(p, rect, f)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // points p with dist2((x, y), p) < r^2
+  void queryCircle(Coor x, Coor y, Coor r, std::vector<const Point*> &result) const
+  {
+    result.clear();
+    queryCircle(root, x, y, r*r, result);
+  }
+
+  void queryCircle(Node *node, Coor x, Coor y, Coor r2, std::vector<const Point*> &result) const
+  {
+    if (!node->leafPoints.empty()) {
+
+      if (minDist2(x, y, node->pointsBB) >= r2) {
+        return;
+      }
+      
+      for (const auto p : node->leafPoints) {
+        if (dist2(x, y, p) < r2) {
+          result.push_back(p);
+        }
+      }      
+      return;
+    }
+
+    for (Node *p : node->children) {
+      if (p && minDist2(x, y, p->rect) < r2) {
+        queryCircle(p, x, y, r2, result);
+      }
+    }
+  }
+
+  // up to k points closest to (x, y) with dist2 < maxR^2 for which
+  // accept(p) is true, ordered by increasing distance (ties: tieLess,
+  // default by address)
+  //
+  // best-first search: nodes are expanded in order of their distance,
+  // so search stops as soon as k points have been found
+  template <typename Accept, typename TieLess = std::less<const Point*>>
+  void queryNearest(Coor x, Coor y, size_t k, Coor maxR, std::vector<const Point*> &result,
+                    Accept accept, TieLess tieLess = TieLess()) const
+  {
+    result.clear();
+
+    if (k == 0) {
+      return;
+    }
+
+    Coor maxR2 = maxR * maxR;
+
+    // search frontier (node or point); kept per thread to avoid allocations
+    thread_local std::vector<NearEntry> heap;
+
+    // max-heap order => reversed; nodes before points at equal distance
+    // (a node may contain points at that distance which come first)
+    auto later = [&tieLess](const NearEntry &a, const NearEntry &b) {
+      if (a.d2 != b.d2) { return a.d2 > b.d2; }
+      if ((a.point != nullptr) != (b.point != nullptr)) { return a.point != nullptr; }
+      return a.point != nullptr && tieLess(b.point, a.point);
+    };
+
+    heap.clear();
+    heap.push_back({ minDist2(x, y, root->rect), root, nullptr });
+
+    while (!heap.empty()) {
+
+      std::pop_heap(heap.begin(), heap.end(), later);
+      NearEntry e = heap.back();
+      heap.pop_back();
+
+      if (e.point) {
+        result.push_back(e.point);
+        if (result.size() >= k) {
+          break;
+        }
+        continue;
+      }
+
+      const Node *node = e.node;
+      
+      if (!node->leafPoints.empty()) {
+
+        for (const auto p : node->leafPoints) {
+          Coor d2 = dist2(x, y, p);
+          if (d2 < maxR2 && accept(p)) {
+            heap.push_back({ d2, nullptr, p });
+            std::push_heap(heap.begin(), heap.end(), later);
+          }
+        }
+        continue;
+      }
+
+      for (const Node *p : node->children) {
+        if (p) {
+          Coor d2 = minDist2(x, y, p->rect);
+          if (d2 < maxR2) {
+            heap.push_back({ d2, p, nullptr });
+            std::push_heap(heap.begin(), heap.end(), later);
+          }
+        }
+      }
+    }
+  }
+
+  // same, accepting all points
+  void queryNearest(Coor x, Coor y, size_t k, Coor maxR, std::vector<const Point*> &result) const
+  {
+    queryNearest(x, y, k, maxR, result, [](const Point *) { return true; });
+  }
+  
   static void test();
   
 private:
+
+  size_t leafBytes(const Node *node) const
+  {
+    if (node->isLeaf()) {
+      return node->leafPoints.capacity() * sizeof(const Point*);
+    }
+
+    size_t sum = 0;
+    for (const Node *p : node->children) {
+      sum += leafBytes(p);
+    }
+    return sum;
+  }
+
+  // best-first search entry (node or point)
+  struct NearEntry
+  {
+    Coor d2;
+    const Node *node;
+    const Point *point;
+  };
+
     
   Coor width, height;
   Coor eps;
   Node *root;
+  Pool<Node> pool;
+  size_t allocs;     // pool allocations at last clear()
+  size_t leafAllocs; // leaf point buffer growths since last clear()
 };
 
 
@@ -0,0 +1,674 @@
+#include "RangeKernels.h"
+#include <algorithm>
+
+#if defined(__x86_64__)
+#define RANGE_KERNELS_X86 1
+#include <immintrin.h>
+#else
+#define RANGE_KERNELS_X86 0
+#endif
+
+using namespace std;
+
+/* scalar code
+
+   also handles the tails of the vector versions: they pass the index to
+   start at and the best candidate found so far
+
+   of candidates with equal keys the one with the smaller id wins, so the
+   result doesn't depend on the order of the arrays
+*/
+
+static inline bool inRange1(fp_t x, fp_t y, fp_t range, const RangeArrays &c, size_t j, fp_t &d2)
+{
+  d2 = square(x - c.x[j]) + square(y - c.y[j]);
+  return d2 < square(range + c.r[j]);
+}
+
+static size_t inRangeScalar(fp_t x, fp_t y, fp_t range, const RangeArrays &c,
+                            size_t j, uint32_t *out, size_t k)
+{
+  fp_t d2;
+  for (; j < c.n; ++j) {
+    if (inRange1(x, y, range, c, j, d2)) {
+      out[k++] = static_cast<uint32_t>(j);
+    }
+  }
+  return k;
+}
+
+static int closestScalar(fp_t x, fp_t y, fp_t range, const RangeArrays &c,
+                         size_t j, int best, fp_t bestD2)
+{
+  fp_t d2;
+  for (; j < c.n; ++j) {
+    if (inRange1(x, y, range, c, j, d2) &&
+        (best < 0 || d2 < bestD2 || (d2 == bestD2 && c.id[j] < c.id[best]))) {
+      best = static_cast<int>(j);
+      bestD2 = d2;
+    }
+  }
+  return best;
+}
+
+static int minKeyScalar(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const int *key,
+                        size_t j, int best, int bestKey)
+{
+  fp_t d2;
+  for (; j < c.n; ++j) {
+    if (inRange1(x, y, range, c, j, d2) &&
+        (best < 0 || key[j] < bestKey || (key[j] == bestKey && c.id[j] < c.id[best]))) {
+      best = static_cast<int>(j);
+      bestKey = key[j];
+    }
+  }
+  return best;
+}
+
+static int maxKeyScalar(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const double *key,
+                        size_t j, int best, double bestKey)
+{
+  fp_t d2;
+  for (; j < c.n; ++j) {
+    if (inRange1(x, y, range, c, j, d2) &&
+        (best < 0 || key[j] > bestKey || (key[j] == bestKey && c.id[j] < c.id[best]))) {
+      best = static_cast<int>(j);
+      bestKey = key[j];
+    }
+  }
+  return best;
+}
+
+// reduce per-lane optima (lane index < 0: none) to overall optimum with
+// smallest id
+template <typename T, typename I, bool MIN>
+static int reduceLanes(const T *value, const I *index, int lanes, const int *id, T &bestValue)
+{
+  int best = -1;
+
+  for (int l=0; l < lanes; ++l) {
+    int i = static_cast<int>(index[l]);
+    if (i < 0) {
+      continue;
+    }
+    bool better = MIN ? value[l] < bestValue : value[l] > bestValue;
+    if (best < 0 || better || (value[l] == bestValue && id[i] < id[best])) {
+      best = i;
+      bestValue = value[l];
+    }
+  }
+  return best;
+}
+
+static size_t inRangeS(fp_t x, fp_t y, fp_t range, const RangeArrays &c, uint32_t *out)
+{
+  return inRangeScalar(x, y, range, c, 0, out, 0);
+}
+
+static int closestS(fp_t x, fp_t y, fp_t range, const RangeArrays &c)
+{
+  return closestScalar(x, y, range, c, 0, -1, 0);
+}
+
+static int minKeyS(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const int *key)
+{
+  return minKeyScalar(x, y, range, c, key, 0, -1, 0);
+}
+
+static int maxKeyS(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const double *key)
+{
+  return maxKeyScalar(x, y, range, c, key, 0, -1, 0);
+}
+
+
+#if RANGE_KERNELS_X86
+
+/* SSE2: 4 candidates per step */
+
+static inline __m128 inRange4(__m128 vx, __m128 vy, __m128 vr, const RangeArrays &c, size_t j,
+                              __m128 &d2)
+{
+  __m128 dx = _mm_sub_ps(vx, _mm_loadu_ps(c.x + j));
+  __m128 dy = _mm_sub_ps(vy, _mm_loadu_ps(c.y + j));
+  __m128 rr = _mm_add_ps(vr, _mm_loadu_ps(c.r + j));
+  d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+  return _mm_cmplt_ps(d2, _mm_mul_ps(rr, rr));
+}
+
+static inline __m128i blend4(__m128i a, __m128i b, __m128i mask)
+{
+  return _mm_or_si128(_mm_and_si128(mask, b), _mm_andnot_si128(mask, a));
+}
+
+static inline __m128d blend2(__m128d a, __m128d b, __m128d mask)
+{
+  return _mm_or_pd(_mm_and_pd(mask, b), _mm_andnot_pd(mask, a));
+}
+
+static size_t inRangeSSE2(fp_t x, fp_t y, fp_t range, const RangeArrays &c, uint32_t *out)
+{
+  __m128 vx = _mm_set1_ps(x), vy = _mm_set1_ps(y), vr = _mm_set1_ps(range), d2;
+  size_t j = 0, k = 0;
+
+  for (; j + 4 <= c.n; j += 4) {
+    unsigned m = static_cast<unsigned>(_mm_movemask_ps(inRange4(vx, vy, vr, c, j, d2)));
+    for (; m; m &= m-1) {
+      out[k++] = static_cast<uint32_t>(j + static_cast<size_t>(__builtin_ctz(m)));
+    }
+  }
+  return inRangeScalar(x, y, range, c, j, out, k);
+}
+
+static int closestSSE2(fp_t x, fp_t y, fp_t range, const RangeArrays &c)
+{
+  __m128 vx = _mm_set1_ps(x), vy = _mm_set1_ps(y), vr = _mm_set1_ps(range), d2;
+  __m128 best = _mm_setzero_ps();
+  __m128i bestIdx = _mm_set1_epi32(-1), idx = _mm_setr_epi32(0, 1, 2, 3);
+  __m128i bestId = _mm_setzero_si128();
+  size_t j = 0;
+
+  for (; j + 4 <= c.n; j += 4) {
+    __m128 m = inRange4(vx, vy, vr, c, j, d2);
+    __m128i id = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c.id + j));
+    __m128i none = _mm_cmplt_epi32(bestIdx, _mm_setzero_si128());
+    __m128i tie = _mm_and_si128(_mm_castps_si128(_mm_cmpeq_ps(d2, best)), _mm_cmplt_epi32(id, bestId));
+    __m128i upd = _mm_and_si128(_mm_castps_si128(m),
+                                _mm_or_si128(_mm_or_si128(none, tie),
+                                             _mm_castps_si128(_mm_cmplt_ps(d2, best))));
+    best = _mm_castsi128_ps(blend4(_mm_castps_si128(best), _mm_castps_si128(d2), upd));
+    bestIdx = blend4(bestIdx, idx, upd);
+    bestId = blend4(bestId, id, upd);
+    idx = _mm_add_epi32(idx, _mm_set1_epi32(4));
+  }
+
+  alignas(16) fp_t v[4];
+  alignas(16) int32_t i[4];
+  _mm_store_ps(v, best);
+  _mm_store_si128(reinterpret_cast<__m128i*>(i), bestIdx);
+  fp_t bestD2 = 0;
+  int b = reduceLanes<fp_t, int32_t, true>(v, i, 4, c.id, bestD2);
+  return closestScalar(x, y, range, c, j, b, bestD2);
+}
+
+static int minKeySSE2(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const int *key)
+{
+  __m128 vx = _mm_set1_ps(x), vy = _mm_set1_ps(y), vr = _mm_set1_ps(range), d2;
+  __m128i best = _mm_setzero_si128();
+  __m128i bestIdx = _mm_set1_epi32(-1), idx = _mm_setr_epi32(0, 1, 2, 3);
+  __m128i bestId = _mm_setzero_si128();
+  size_t j = 0;
+
+  for (; j + 4 <= c.n; j += 4) {
+    __m128 m = inRange4(vx, vy, vr, c, j, d2);
+    __m128i kj = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + j));
+    __m128i id = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c.id + j));
+    __m128i none = _mm_cmplt_epi32(bestIdx, _mm_setzero_si128());
+    __m128i tie = _mm_and_si128(_mm_cmpeq_epi32(kj, best), _mm_cmplt_epi32(id, bestId));
+    __m128i upd = _mm_and_si128(_mm_castps_si128(m),
+                                _mm_or_si128(_mm_or_si128(none, tie), _mm_cmplt_epi32(kj, best)));
+    best = blend4(best, kj, upd);
+    bestIdx = blend4(bestIdx, idx, upd);
+    bestId = blend4(bestId, id, upd);
+    idx = _mm_add_epi32(idx, _mm_set1_epi32(4));
+  }
+
+  alignas(16) int32_t v[4], i[4];
+  _mm_store_si128(reinterpret_cast<__m128i*>(v), best);
+  _mm_store_si128(reinterpret_cast<__m128i*>(i), bestIdx);
+  int32_t bestKey = 0;
+  int b = reduceLanes<int32_t, int32_t, true>(v, i, 4, c.id, bestKey);
+  return minKeyScalar(x, y, range, c, key, j, b, bestKey);
+}
+
+static int maxKeySSE2(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const double *key)
+{
+  __m128 vx = _mm_set1_ps(x), vy = _mm_set1_ps(y), vr = _mm_set1_ps(range), d2;
+
+  // indexes and ids are kept as doubles (exact), so they can share the key
+  // masks
+  __m128d best = _mm_setzero_pd(), bestIdx = _mm_set1_pd(-1), bestId = _mm_setzero_pd();
+  __m128d idx = _mm_setr_pd(0, 1);
+  size_t j = 0;
+
+  for (; j + 4 <= c.n; j += 4) {
+    __m128i m = _mm_castps_si128(inRange4(vx, vy, vr, c, j, d2));
+
+    // 32 bit lane masks => 64 bit
+    __m128d mh[2] = { _mm_castsi128_pd(_mm_unpacklo_epi32(m, m)),
+                      _mm_castsi128_pd(_mm_unpackhi_epi32(m, m)) };
+
+    for (size_t h=0; h < 2; ++h) {
+      __m128d kj = _mm_loadu_pd(key + j + 2*h);
+      __m128d id = _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(c.id + j + 2*h)));
+      __m128d none = _mm_cmplt_pd(bestIdx, _mm_setzero_pd());
+      __m128d tie = _mm_and_pd(_mm_cmpeq_pd(kj, best), _mm_cmplt_pd(id, bestId));
+      __m128d upd = _mm_and_pd(mh[h], _mm_or_pd(_mm_or_pd(none, tie), _mm_cmpgt_pd(kj, best)));
+      best = blend2(best, kj, upd);
+      bestIdx = blend2(bestIdx, idx, upd);
+      bestId = blend2(bestId, id, upd);
+      idx = _mm_add_pd(idx, _mm_set1_pd(2));
+    }
+  }
+
+  alignas(16) double v[2], i[2];
+  _mm_store_pd(v, best);
+  _mm_store_pd(i, bestIdx);
+  double bestKey = 0;
+  int b = reduceLanes<double, double, false>(v, i, 2, c.id, bestKey);
+  return maxKeyScalar(x, y, range, c, key, j, b, bestKey);
+}
+
+
+/* AVX2: 8 candidates per step */
+
+#define AVX2_FN __attribute__((target("avx2")))
+
+AVX2_FN static inline __m256 inRange8(__m256 vx, __m256 vy, __m256 vr, const RangeArrays &c,
+                                      size_t j, __m256 &d2)
+{
+  __m256 dx = _mm256_sub_ps(vx, _mm256_loadu_ps(c.x + j));
+  __m256 dy = _mm256_sub_ps(vy, _mm256_loadu_ps(c.y + j));
+  __m256 rr = _mm256_add_ps(vr, _mm256_loadu_ps(c.r + j));
+  d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+  return _mm256_cmp_ps(d2, _mm256_mul_ps(rr, rr), _CMP_LT_OQ);
+}
+
+AVX2_FN static size_t inRangeAVX2(fp_t x, fp_t y, fp_t range, const RangeArrays &c, uint32_t *out)
+{
+  __m256 vx = _mm256_set1_ps(x), vy = _mm256_set1_ps(y), vr = _mm256_set1_ps(range), d2;
+  size_t j = 0, k = 0;
+
+  for (; j + 8 <= c.n; j += 8) {
+    unsigned m = static_cast<unsigned>(_mm256_movemask_ps(inRange8(vx, vy, vr, c, j, d2)));
+    for (; m; m &= m-1) {
+      out[k++] = static_cast<uint32_t>(j + static_cast<size_t>(__builtin_ctz(m)));
+    }
+  }
+  return inRangeScalar(x, y, range, c, j, out, k);
+}
+
+AVX2_FN static int closestAVX2(fp_t x, fp_t y, fp_t range, const RangeArrays &c)
+{
+  __m256 vx = _mm256_set1_ps(x), vy = _mm256_set1_ps(y), vr = _mm256_set1_ps(range), d2;
+  __m256 best = _mm256_setzero_ps();
+  __m256i bestIdx = _mm256_set1_epi32(-1), idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i bestId = _mm256_setzero_si256();
+  size_t j = 0;
+
+  for (; j + 8 <= c.n; j += 8) {
+    __m256 m = inRange8(vx, vy, vr, c, j, d2);
+    __m256i id = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.id + j));
+    __m256 none = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_setzero_si256(), bestIdx));
+    __m256 tie = _mm256_and_ps(_mm256_cmp_ps(d2, best, _CMP_EQ_OQ),
+                               _mm256_castsi256_ps(_mm256_cmpgt_epi32(bestId, id)));
+    __m256 upd = _mm256_and_ps(m, _mm256_or_ps(_mm256_or_ps(none, tie),
+                                               _mm256_cmp_ps(d2, best, _CMP_LT_OQ)));
+    best = _mm256_blendv_ps(best, d2, upd);
+    bestIdx = _mm256_blendv_epi8(bestIdx, idx, _mm256_castps_si256(upd));
+    bestId = _mm256_blendv_epi8(bestId, id, _mm256_castps_si256(upd));
+    idx = _mm256_add_epi32(idx, _mm256_set1_epi32(8));
+  }
+
+  alignas(32) fp_t v[8];
+  alignas(32) int32_t i[8];
+  _mm256_store_ps(v, best);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(i), bestIdx);
+  fp_t bestD2 = 0;
+  int b = reduceLanes<fp_t, int32_t, true>(v, i, 8, c.id, bestD2);
+  return closestScalar(x, y, range, c, j, b, bestD2);
+}
+
+AVX2_FN static int minKeyAVX2(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const int *key)
+{
+  __m256 vx = _mm256_set1_ps(x), vy = _mm256_set1_ps(y), vr = _mm256_set1_ps(range), d2;
+  __m256i best = _mm256_setzero_si256();
+  __m256i bestIdx = _mm256_set1_epi32(-1), idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i bestId = _mm256_setzero_si256();
+  size_t j = 0;
+
+  for (; j + 8 <= c.n; j += 8) {
+    __m256i m = _mm256_castps_si256(inRange8(vx, vy, vr, c, j, d2));
+    __m256i kj = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + j));
+    __m256i id = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.id + j));
+    __m256i none = _mm256_cmpgt_epi32(_mm256_setzero_si256(), bestIdx);
+    __m256i tie = _mm256_and_si256(_mm256_cmpeq_epi32(kj, best), _mm256_cmpgt_epi32(bestId, id));
+    __m256i upd = _mm256_and_si256(m, _mm256_or_si256(_mm256_or_si256(none, tie),
+                                                      _mm256_cmpgt_epi32(best, kj)));
+    best = _mm256_blendv_epi8(best, kj, upd);
+    bestIdx = _mm256_blendv_epi8(bestIdx, idx, upd);
+    bestId = _mm256_blendv_epi8(bestId, id, upd);
+    idx = _mm256_add_epi32(idx, _mm256_set1_epi32(8));
+  }
+
+  alignas(32) int32_t v[8], i[8];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(v), best);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(i), bestIdx);
+  int32_t bestKey = 0;
+  int b = reduceLanes<int32_t, int32_t, true>(v, i, 8, c.id, bestKey);
+  return minKeyScalar(x, y, range, c, key, j, b, bestKey);
+}
+
+AVX2_FN static int maxKeyAVX2(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const double *key)
+{
+  __m256 vx = _mm256_set1_ps(x), vy = _mm256_set1_ps(y), vr = _mm256_set1_ps(range), d2;
+  __m256d best = _mm256_setzero_pd(), bestIdx = _mm256_set1_pd(-1), bestId = _mm256_setzero_pd();
+  __m256d idx = _mm256_setr_pd(0, 1, 2, 3);
+  size_t j = 0;
+
+  for (; j + 8 <= c.n; j += 8) {
+    __m256i m = _mm256_castps_si256(inRange8(vx, vy, vr, c, j, d2));
+
+    // 32 bit lane masks => 64 bit (sign extension)
+    __m256d mh[2] = { _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(m))),
+                      _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(m, 1))) };
+
+    for (size_t h=0; h < 2; ++h) {
+      __m256d kj = _mm256_loadu_pd(key + j + 4*h);
+      __m256d id = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c.id + j + 4*h)));
+      __m256d none = _mm256_cmp_pd(bestIdx, _mm256_setzero_pd(), _CMP_LT_OQ);
+      __m256d tie = _mm256_and_pd(_mm256_cmp_pd(kj, best, _CMP_EQ_OQ),
+                                  _mm256_cmp_pd(id, bestId, _CMP_LT_OQ));
+      __m256d upd = _mm256_and_pd(mh[h], _mm256_or_pd(_mm256_or_pd(none, tie),
+                                                      _mm256_cmp_pd(kj, best, _CMP_GT_OQ)));
+      best = _mm256_blendv_pd(best, kj, upd);
+      bestIdx = _mm256_blendv_pd(bestIdx, idx, upd);
+      bestId = _mm256_blendv_pd(bestId, id, upd);
+      idx = _mm256_add_pd(idx, _mm256_set1_pd(4));
+    }
+  }
+
+  alignas(32) double v[4], i[4];
+  _mm256_store_pd(v, best);
+  _mm256_store_pd(i, bestIdx);
+  double bestKey = 0;
+  int b = reduceLanes<double, double, false>(v, i, 4, c.id, bestKey);
+  return maxKeyScalar(x, y, range, c, key, j, b, bestKey);
+}
+
+
+/* AVX-512: 16 candidates per step, mask registers */
+
+#define AVX512_FN __attribute__((target("avx512f")))
+
+AVX512_FN static inline __mmask16 inRange16(__m512 vx, __m512 vy, __m512 vr, const RangeArrays &c,
+                                            size_t j, __m512 &d2)
+{
+  __m512 dx = _mm512_sub_ps(vx, _mm512_loadu_ps(c.x + j));
+  __m512 dy = _mm512_sub_ps(vy, _mm512_loadu_ps(c.y + j));
+  __m512 rr = _mm512_add_ps(vr, _mm512_loadu_ps(c.r + j));
+  d2 = _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy));
+  return _mm512_cmp_ps_mask(d2, _mm512_mul_ps(rr, rr), _CMP_LT_OQ);
+}
+
+AVX512_FN static size_t inRangeAVX512(fp_t x, fp_t y, fp_t range, const RangeArrays &c, uint32_t *out)
+{
+  __m512 vx = _mm512_set1_ps(x), vy = _mm512_set1_ps(y), vr = _mm512_set1_ps(range), d2;
+  __m512i idx = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  size_t j = 0, k = 0;
+
+  for (; j + 16 <= c.n; j += 16) {
+    __mmask16 m = inRange16(vx, vy, vr, c, j, d2);
+    _mm512_mask_compressstoreu_epi32(out + k, m, idx);
+    k += static_cast<size_t>(__builtin_popcount(m));
+    idx = _mm512_add_epi32(idx, _mm512_set1_epi32(16));
+  }
+  return inRangeScalar(x, y, range, c, j, out, k);
+}
+
+AVX512_FN static int closestAVX512(fp_t x, fp_t y, fp_t range, const RangeArrays &c)
+{
+  __m512 vx = _mm512_set1_ps(x), vy = _mm512_set1_ps(y), vr = _mm512_set1_ps(range), d2;
+  __m512 best = _mm512_setzero_ps();
+  __m512i bestIdx = _mm512_set1_epi32(-1), bestId = _mm512_setzero_si512();
+  __m512i idx = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  size_t j = 0;
+
+  for (; j + 16 <= c.n; j += 16) {
+    __mmask16 m = inRange16(vx, vy, vr, c, j, d2);
+    __m512i id = _mm512_loadu_si512(c.id + j);
+    __mmask16 none = _mm512_cmplt_epi32_mask(bestIdx, _mm512_setzero_si512());
+    __mmask16 tie = _mm512_cmp_ps_mask(d2, best, _CMP_EQ_OQ) & _mm512_cmplt_epi32_mask(id, bestId);
+    __mmask16 upd = m & (none | tie | _mm512_cmp_ps_mask(d2, best, _CMP_LT_OQ));
+    best = _mm512_mask_mov_ps(best, upd, d2);
+    bestIdx = _mm512_mask_mov_epi32(bestIdx, upd, idx);
+    bestId = _mm512_mask_mov_epi32(bestId, upd, id);
+    idx = _mm512_add_epi32(idx, _mm512_set1_epi32(16));
+  }
+
+  alignas(64) fp_t v[16];
+  alignas(64) int32_t i[16];
+  _mm512_store_ps(v, best);
+  _mm512_store_si512(i, bestIdx);
+  fp_t bestD2 = 0;
+  int b = reduceLanes<fp_t, int32_t, true>(v, i, 16, c.id, bestD2);
+  return closestScalar(x, y, range, c, j, b, bestD2);
+}
+
+AVX512_FN static int minKeyAVX512(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const int *key)
+{
+  __m512 vx = _mm512_set1_ps(x), vy = _mm512_set1_ps(y), vr = _mm512_set1_ps(range), d2;
+  __m512i best = _mm512_setzero_si512();
+  __m512i bestIdx = _mm512_set1_epi32(-1), bestId = _mm512_setzero_si512();
+  __m512i idx = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  size_t j = 0;
+
+  for (; j + 16 <= c.n; j += 16) {
+    __mmask16 m = inRange16(vx, vy, vr, c, j, d2);
+    __m512i kj = _mm512_loadu_si512(key + j);
+    __m512i id = _mm512_loadu_si512(c.id + j);
+    __mmask16 none = _mm512_cmplt_epi32_mask(bestIdx, _mm512_setzero_si512());
+    __mmask16 tie = _mm512_cmpeq_epi32_mask(kj, best) & _mm512_cmplt_epi32_mask(id, bestId);
+    __mmask16 upd = m & (none | tie | _mm512_cmplt_epi32_mask(kj, best));
+    best = _mm512_mask_mov_epi32(best, upd, kj);
+    bestIdx = _mm512_mask_mov_epi32(bestIdx, upd, idx);
+    bestId = _mm512_mask_mov_epi32(bestId, upd, id);
+    idx = _mm512_add_epi32(idx, _mm512_set1_epi32(16));
+  }
+
+  alignas(64) int32_t v[16], i[16];
+  _mm512_store_si512(v, best);
+  _mm512_store_si512(i, bestIdx);
+  int32_t bestKey = 0;
+  int b = reduceLanes<int32_t, int32_t, true>(v, i, 16, c.id, bestKey);
+  return minKeyScalar(x, y, range, c, key, j, b, bestKey);
+}
+
+AVX512_FN static int maxKeyAVX512(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const double *key)
+{
+  __m512 vx = _mm512_set1_ps(x), vy = _mm512_set1_ps(y), vr = _mm512_set1_ps(range), d2;
+  __m512d best = _mm512_setzero_pd(), bestIdx = _mm512_set1_pd(-1), bestId = _mm512_setzero_pd();
+  __m512d idx = _mm512_setr_pd(0, 1, 2, 3, 4, 5, 6, 7);
+  size_t j = 0;
+
+  for (; j + 16 <= c.n; j += 16) {
+    __mmask16 m = inRange16(vx, vy, vr, c, j, d2);
+
+    for (unsigned h=0; h < 2; ++h) {
+      __mmask8 mh = static_cast<__mmask8>(m >> (8*h));
+      __m512d kj = _mm512_loadu_pd(key + j + 8*h);
+      // (maskz: _mm512_cvtepi32_pd triggers -Wmaybe-uninitialized in gcc 12)
+      __m512d id = _mm512_maskz_cvtepi32_pd(0xff, _mm256_loadu_si256(
+                                              reinterpret_cast<const __m256i*>(c.id + j + 8*h)));
+      __mmask8 none = _mm512_cmp_pd_mask(bestIdx, _mm512_setzero_pd(), _CMP_LT_OQ);
+      __mmask8 tie = _mm512_cmp_pd_mask(kj, best, _CMP_EQ_OQ) & _mm512_cmp_pd_mask(id, bestId, _CMP_LT_OQ);
+      __mmask8 upd = mh & (none | tie | _mm512_cmp_pd_mask(kj, best, _CMP_GT_OQ));
+      best = _mm512_mask_mov_pd(best, upd, kj);
+      bestIdx = _mm512_mask_mov_pd(bestIdx, upd, idx);
+      bestId = _mm512_mask_mov_pd(bestId, upd, id);
+      idx = _mm512_add_pd(idx, _mm512_set1_pd(8));
+    }
+  }
+
+  alignas(64) double v[8], i[8];
+  _mm512_store_pd(v, best);
+  _mm512_store_pd(i, bestIdx);
+  double bestKey = 0;
+  int b = reduceLanes<double, double, false>(v, i, 8, c.id, bestKey);
+  return maxKeyScalar(x, y, range, c, key, j, b, bestKey);
+}
+
+#endif
+
+
+static RangeKernels::Impl implFor(RangeKernels::Level level)
+{
+  switch (level) {
+
+    case RangeKernels::SCALAR:
+      return { inRangeS, closestS, minKeyS, maxKeyS };
+
+#if RANGE_KERNELS_X86
+    case RangeKernels::SSE2:
+      return { inRangeSSE2, closestSSE2, minKeySSE2, maxKeySSE2 };
+
+    case RangeKernels::AVX2:
+      return { inRangeAVX2, closestAVX2, minKeyAVX2, maxKeyAVX2 };
+
+    case RangeKernels::AVX512:
+      return { inRangeAVX512, closestAVX512, minKeyAVX512, maxKeyAVX512 };
+#endif
+
+    default:
+      break;
+  }
+
+  ERR("RangeKernels: level " << RangeKernels::levelToString(level) << " not supported");
+}
+
+RangeKernels::Level RangeKernels::level = RangeKernels::detect();
+RangeKernels::Impl RangeKernels::impl = implFor(RangeKernels::level);
+
+
+string RangeKernels::levelToString(Level level)
+{
+  switch (level) {
+    case SCALAR: return "scalar";
+    case SSE2:   return "sse2";
+    case AVX2:   return "avx2";
+    case AVX512: return "avx512";
+  }
+
+  ERR("RangeKernels: unknown level " << level);
+}
+
+RangeKernels::Level RangeKernels::levelFromString(const string &s)
+{
+  if (s == "scalar") {
+    return SCALAR;
+  } else if (s == "sse2") {
+    return SSE2;
+  } else if (s == "avx2") {
+    return AVX2;
+  } else if (s == "avx512") {
+    return AVX512;
+  } else if (s == "auto") {
+    return detect();
+  }
+
+  ERR("RangeKernels: unknown level '" << s << "'");
+}
+
+RangeKernels::Level RangeKernels::detect()
+{
+#if RANGE_KERNELS_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx512f")) {
+    return AVX512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return AVX2;
+  }
+  return SSE2; // x86-64 baseline
+#else
+  return SCALAR;
+#endif
+}
+
+void RangeKernels::select(Level level_)
+{
+  if (level_ > detect()) {
+    ERR("RangeKernels: cpu doesn't support " << levelToString(level_));
+  }
+
+  level = level_;
+  impl = implFor(level);
+}
+
+
+/* test
+
+   coordinates and keys are drawn from small sets, so that distance and key
+   ties are frequent and boundary cases (d2 == range^2) occur; candidate
+   counts cover vector tails
+*/
+
+void rangeKernelsTest()
+{
+  RNG rng;
+  rng.seed(0);
+
+  constexpr int N = 100'000; // candidate sets
+
+  auto rndInt = [&](int n) { return static_cast<int>(rng() % static_cast<unsigned>(n)); };
+
+  RangeKernels::Impl ref = implFor(RangeKernels::SCALAR);
+  vector<fp_t> x, y, r;
+  vector<int> hp, id;
+  vector<double> danger;
+  vector<uint32_t> out, refOut;
+
+  for (int l = RangeKernels::SSE2; l <= RangeKernels::detect(); ++l) {
+
+    auto level = static_cast<RangeKernels::Level>(l);
+    RangeKernels::Impl impl = implFor(level);
+
+    cout << RangeKernels::levelToString(level) << " " << flush;
+
+    for (int i=0; i < N; ++i) {
+
+      size_t n = static_cast<size_t>(rndInt(80));
+
+      x.resize(n);
+      y.resize(n);
+      r.resize(n);
+      hp.resize(n);
+      id.resize(n);
+      danger.resize(n);
+      out.resize(n);
+      refOut.resize(n);
+
+      for (size_t j=0; j < n; ++j) {
+        x[j] = static_cast<fp_t>(rndInt(64)) * 0.5f;
+        y[j] = static_cast<fp_t>(rndInt(64)) * 0.5f;
+        r[j] = static_cast<fp_t>(rndInt(3) * 4);
+        hp[j] = 1 + rndInt(5);
+        danger[j] = static_cast<double>(1 + rndInt(3)) / (1 + rndInt(3)) / hp[j];
+        id[j] = static_cast<int>(j);
+      }
+
+      // distinct ids in random order
+      for (size_t j=n; j > 1; --j) {
+        swap(id[j-1], id[static_cast<size_t>(rndInt(static_cast<int>(j)))]);
+      }
+
+      RangeArrays c{ x.data(), y.data(), r.data(), id.data(), n };
+      fp_t ux = static_cast<fp_t>(rndInt(64)) * 0.5f;
+      fp_t uy = static_cast<fp_t>(rndInt(64)) * 0.5f;
+      fp_t range = static_cast<fp_t>(rndInt(40));
+
+      size_t k = impl.inRange(ux, uy, range, c, out.data());
+      size_t refK = ref.inRange(ux, uy, range, c, refOut.data());
+
+      if (k != refK || !equal(out.begin(), out.begin() + static_cast<ptrdiff_t>(k), refOut.begin())) {
+        ERR("rangeKernelsTest: inRange mismatch");
+      }
+
+      if (impl.closest(ux, uy, range, c) != ref.closest(ux, uy, range, c) ||
+          impl.minKey(ux, uy, range, c, hp.data()) != ref.minKey(ux, uy, range, c, hp.data()) ||
+          impl.maxKey(ux, uy, range, c, danger.data()) != ref.maxKey(ux, uy, range, c, danger.data())) {
+        ERR("rangeKernelsTest: selection mismatch");
+      }
+    }
+  }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// batched range tests over candidate arrays (structure of arrays)
+//
+// candidate j is in range of center (x, y) with range r iff
+//
+//   square(x - cx[j]) + square(y - cy[j]) < square(r + cr[j])
+//
+// which is World::canAttack / World::canSee with range = attack or vision
+// range; the selection kernels return the index of the optimal in-range
+// candidate (-1 if none), of several the one with the smallest id; with
+// unitIds as ids that's the unit the scalar PlayerView::*TargetIndexes
+// functions put first, whatever the order of the candidates
+//
+// besides the scalar code there are SSE2, AVX2, and AVX-512 versions
+// selected at startup depending on the cpu; they evaluate exactly the same
+// float operations (no fma, no reassociation), so results are bit-identical
+// on all levels and games don't depend on the machine they run on
+//
+// the level selected here also picks the UnitStore motion kernel
+
+#include "Global.h"
+#include <string>
+
+struct RangeArrays
+{
+  const fp_t *x = nullptr;
+  const fp_t *y = nullptr;
+  const fp_t *r = nullptr; // radii
+  const int *id = nullptr; // distinct, break selection ties
+  size_t n = 0;
+};
+
+class RangeKernels
+{
+public:
+
+  enum Level { SCALAR=0, SSE2, AVX2, AVX512 };
+
+  static std::string levelToString(Level level);
+  static Level levelFromString(const std::string &s);
+
+  // best level supported by cpu
+  static Level detect();
+
+  // use level (ERR if not supported)
+  static void select(Level level);
+
+  static Level getLevel() { return level; }
+
+  // indexes of in-range candidates (increasing) => out, which must have
+  // room for c.n entries
+  // @return number of indexes
+  static size_t inRange(fp_t x, fp_t y, fp_t range, const RangeArrays &c, uint32_t *out)
+  {
+    return impl.inRange(x, y, range, c, out);
+  }
+
+  // in-range candidate with minimal distance
+  static int closest(fp_t x, fp_t y, fp_t range, const RangeArrays &c)
+  {
+    return impl.closest(x, y, range, c);
+  }
+
+  // in-range candidate with minimal key (e.g. hp)
+  static int minKey(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const int *key)
+  {
+    return impl.minKey(x, y, range, c, key);
+  }
+
+  // in-range candidate with maximal key (e.g. danger)
+  static int maxKey(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const double *key)
+  {
+    return impl.maxKey(x, y, range, c, key);
+  }
+
+  struct Impl
+  {
+    size_t (*inRange)(fp_t x, fp_t y, fp_t range, const RangeArrays &c, uint32_t *out);
+    int (*closest)(fp_t x, fp_t y, fp_t range, const RangeArrays &c);
+    int (*minKey)(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const int *key);
+    int (*maxKey)(fp_t x, fp_t y, fp_t range, const RangeArrays &c, const double *key);
+  };
+
+private:
+
+  static Level level;
+  static Impl impl;
+};
+
+// compares all supported levels against scalar code on random data
+// (ERR on mismatch)
+extern void rangeKernelsTest();
@@ -0,0 +1,311 @@
+#include "Replay.h"
+#include <algorithm>
+
+using namespace std;
+
+// frame a STATE / ACTIONS / END payload belongs to
+static int chunkFrame(const Serial::Header &h, const char *payload)
+{
+  int32_t frame;
+
+  if (h.size < sizeof(frame)) {
+    ERR("Replay: chunk too short");
+  }
+  memcpy(&frame, payload, sizeof(frame));
+  return frame;
+}
+
+
+ReplayRecorder::ReplayRecorder(const string &file_, const GameSpec &spec,
+                               const World &world, int keyframeInterval_)
+  : os(file_, ios::binary), file(file_), keyframeInterval(keyframeInterval_)
+{
+  if (!os) {
+    ERR("can't open " << file << " for writing");
+  }
+
+  if (keyframeInterval < 1) {
+    ERR("keyframe interval must be positive");
+  }
+
+  Serial::Writer w(buf);
+  string args = Game::specToArgs(spec);
+
+  size_t at = w.begin(Serial::REPLAY);
+  w.put(Serial::ReplayHeader{ keyframeInterval, static_cast<uint32_t>(args.size()) });
+  w.put(args.data(), args.size());
+  w.finish(at);
+
+  world.writeState(w);
+  hashes.push_back(world.getStateHash());
+  flush();
+}
+
+
+ReplayRecorder::~ReplayRecorder()
+{
+}
+
+
+void ReplayRecorder::onFrame(World &world)
+{
+  Serial::Writer w(buf);
+  int frame = world.getFrameCount(); // frames executed
+
+  for (int p=0; p < 2; ++p) {
+    const map<int, Action> &actions = world.getSelfView(p).getActions();
+    if (!actions.empty()) {
+      Serial::writeActions(w, frame-1, p, actions);
+    }
+  }
+
+  hashes.push_back(world.getStateHash());
+
+  if (frame % keyframeInterval == 0) {
+    writeHashes();
+    world.writeState(w);
+  }
+
+  flush();
+}
+
+
+void ReplayRecorder::finish(const World &world)
+{
+  if (finished) {
+    return;
+  }
+
+  writeHashes();
+
+  Serial::Writer w(buf);
+
+  size_t at = w.begin(Serial::END);
+  w.put(static_cast<int32_t>(world.getFrameCount()));
+  w.finish(at);
+  flush();
+
+  os.close();
+
+  if (!os) {
+    ERR("can't write " << file);
+  }
+
+  finished = true;
+}
+
+
+void ReplayRecorder::writeHashes()
+{
+  if (hashes.empty()) {
+    return;
+  }
+
+  Serial::Writer w(buf);
+
+  size_t at = w.begin(Serial::HASHES);
+  w.put(Serial::HashesHeader{ hashesFrame, static_cast<int32_t>(hashes.size()) });
+  w.put(hashes.data(), hashes.size());
+  w.finish(at);
+
+  hashesFrame += static_cast<int>(hashes.size());
+  hashes.clear();
+}
+
+
+void ReplayRecorder::flush()
+{
+  os.write(buf.data(), static_cast<streamsize>(buf.size()));
+  buf.clear();
+}
+
+
+Replay::Replay(const string &file)
+{
+  {
+    ifstream is(file, ios::binary | ios::ate);
+
+    if (!is) {
+      ERR("can't open " << file);
+    }
+
+    data.resize(static_cast<size_t>(is.tellg()));
+    is.seekg(0);
+    is.read(data.data(), static_cast<streamsize>(data.size()));
+
+    if (!is) {
+      ERR("can't read " << file);
+    }
+  }
+
+  // index keyframes
+
+  Serial::Reader r(data);
+  bool haveSpec = false;
+
+  while (!r.atEnd()) {
+
+    size_t offset = static_cast<size_t>(r.pos() - data.data());
+    Serial::Header h = r.header();
+    const char *first = r.skip(h.size);
+    Serial::Reader payload(first, r.pos());
+
+    if (!haveSpec && h.kind != Serial::REPLAY) {
+      ERR(file << " is not a replay");
+    }
+
+    switch (h.kind) {
+
+      case Serial::REPLAY: {
+        Serial::ReplayHeader rh;
+        payload.get(rh);
+        string args(payload.skip(rh.specLength), rh.specLength);
+        recordedSpec = Game::specFromArgs(args, file);
+        keyframeInterval = rh.keyframeInterval;
+        haveSpec = true;
+        break;
+      }
+
+      case Serial::STATE:
+        keyframes.push_back({ chunkFrame(h, payload.pos()), offset });
+        break;
+
+      case Serial::END:
+        endFrame = chunkFrame(h, payload.pos());
+        break;
+
+      case Serial::HASHES: {
+        Serial::HashesHeader hh;
+        payload.get(hh);
+        if (hh.frame != static_cast<int>(recordedHashes.size()) || hh.count < 0) {
+          ERR(file << ": state hashes out of order");
+        }
+        size_t n = recordedHashes.size();
+        recordedHashes.resize(n + static_cast<size_t>(hh.count));
+        payload.get(recordedHashes.data() + n, static_cast<size_t>(hh.count));
+        break;
+      }
+
+      default:
+        break; // actions, or unknown
+    }
+  }
+
+  if (keyframes.empty() || keyframes[0].frame != 0) {
+    ERR(file << ": initial state missing");
+  }
+
+  // same world, but no player code (and no kinetic ranges, which only let
+  // players skip range queries)
+
+  GameSpec spec = recordedSpec;
+  spec.redPlayer = spec.bluePlayer = "Extern";
+  spec.playerThreads = spec.unitThreads = 1;
+  spec.kinetic = false;
+  game.reset(new Game(spec));
+
+  restore(keyframes[0].offset);
+}
+
+
+void Replay::restore(size_t offset)
+{
+  Serial::Reader r(data.data() + offset, data.data() + data.size());
+  Serial::Header h = r.header();
+
+  game->getWorld().readState(r);
+  next = offset + sizeof(h) + h.size;
+  checkHash();
+}
+
+
+void Replay::checkHash()
+{
+  const World &world = game->getWorld();
+  size_t frame = static_cast<size_t>(world.getFrameCount());
+
+  if (firstMismatch < 0 && frame < recordedHashes.size() &&
+      world.getStateHash() != recordedHashes[frame]) {
+    firstMismatch = world.getFrameCount();
+  }
+}
+
+
+void Replay::seek(int frame)
+{
+  int now = game->getWorld().getFrameCount();
+
+  // last keyframe <= frame
+  auto it = upper_bound(keyframes.begin(), keyframes.end(), frame,
+                        [](int f, const Keyframe &k) { return f < k.frame; });
+  assert(it != keyframes.begin());
+  --it;
+
+  // just continue if already between that keyframe and frame
+  if (now < it->frame || now > frame) {
+    restore(it->offset);
+  }
+
+  while (game->getWorld().getFrameCount() < frame && step()) { }
+}
+
+
+bool Replay::step()
+{
+  World &world = game->getWorld();
+  int frame = world.getFrameCount();
+
+  if (endFrame >= 0 ? frame >= endFrame : next >= data.size()) {
+    return false;
+  }
+
+  // actions of this frame; keyframes written after earlier frames are
+  // skipped (the state is current already)
+
+  vector<pair<int, Action>> chunk;
+
+  for (auto &a : actions) {
+    a.clear();
+  }
+
+  while (next < data.size()) {
+
+    Serial::Reader r(data.data() + next, data.data() + data.size());
+    Serial::Header h = r.header();
+
+    if (h.kind == Serial::STATE || h.kind == Serial::ACTIONS || h.kind == Serial::END) {
+
+      int f = chunkFrame(h, r.pos());
+
+      if (f > frame) {
+        break;
+      }
+
+      if (h.kind == Serial::ACTIONS) {
+
+        if (f < frame) {
+          ERR("Replay: actions of frame " << f << " out of order");
+        }
+
+        int player;
+        Serial::readActions(r, f, player, chunk);
+
+        if (player < 0 || player > 1) {
+          ERR("Replay: bad player " << player);
+        }
+
+        auto &a = actions[static_cast<size_t>(player)];
+        a.insert(a.end(), chunk.begin(), chunk.end());
+      }
+    }
+
+    next += sizeof(h) + h.size;
+  }
+
+  if (!world.replayFrame(actions)) {
+    return false;
+  }
+
+  checkHash();
+  return true;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+// game replays (csim --record / --replay)
+//
+// a replay file is a sequence of Serial chunks:
+//
+//   REPLAY   game spec (csim options, incl. seed) and keyframe interval
+//   STATE    initial state (frame 0)
+//   ACTIONS  actions each player submitted in frame f (non-empty only)
+//   STATE    keyframe: full state before frame f, every keyframeInterval
+//            frames
+//   HASHES   world state hashes of the frames since the last keyframe
+//   END      frame count when recording stopped
+//
+// in frame order, so a replay is re-executed front to back; keyframes let
+// playback start anywhere without replaying all earlier frames, and keep
+// the cost of seeking independent of the game's length
+//
+// playback executes the recorded actions with World::replayFrame; players
+// (of type Extern) are never run, so it doesn't depend on player code and
+// is much faster than the game was; after each frame the world's state
+// hash is compared to the recorded one, which detects the first frame in
+// which playback diverges (e.g. after simulation code changed)
+
+#include "Global.h"
+#include "Game.h"
+#include "Serial.h"
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ReplayRecorder
+{
+public:
+
+  // starts file with spec and world's current (initial) state
+  ReplayRecorder(const std::string &file, const GameSpec &spec,
+                 const World &world, int keyframeInterval);
+
+  ~ReplayRecorder();
+
+  // after world executed a frame: its actions (+ keyframe)
+  void onFrame(World &world);
+
+  // after last frame: END chunk, close file (once)
+  void finish(const World &world);
+
+private:
+
+  std::ofstream os;
+  std::string file;
+  int keyframeInterval;
+  std::vector<char> buf; // chunks of current frame
+  bool finished = false;
+  std::vector<uint64_t> hashes; // state hashes not written yet
+  int hashesFrame = 0;          // frame count of hashes[0]
+
+  void writeHashes();
+  void flush();
+};
+
+
+class Replay
+{
+public:
+
+  // reads whole file and sets up game at frame 0
+  explicit Replay(const std::string &file);
+
+  // game being replayed (spec as recorded, but with Extern players)
+  Game &getGame() { return *game; }
+
+  const GameSpec &getRecordedSpec() const { return recordedSpec; }
+
+  int getKeyframeInterval() const { return keyframeInterval; }
+
+  // frame count at end of recording (-1: unknown, file was cut short)
+  int getEndFrame() const { return endFrame; }
+
+  // first frame count at which the replayed state hash differed from the
+  // recorded one (-1: none so far)
+  int getFirstMismatch() const { return firstMismatch; }
+
+  // restore nearest keyframe at or before frame and replay from there up
+  // to frame (or end of replay)
+  void seek(int frame);
+
+  // replay next frame
+  // @return false if game or replay is over
+  bool step();
+
+private:
+
+  struct Keyframe
+  {
+    int frame;
+    size_t offset; // of STATE chunk
+  };
+
+  GameSpec recordedSpec;
+  int keyframeInterval = 0;
+  int endFrame = -1;
+  std::vector<char> data;
+  std::vector<Keyframe> keyframes; // ordered by frame
+  std::vector<uint64_t> recordedHashes; // by frame count
+  int firstMismatch = -1;
+  size_t next = 0;                 // offset of next unread chunk
+  std::unique_ptr<Game> game;
+  World::FrameActions actions;     // scratch
+
+  // restore STATE chunk at offset, continue after it
+  void restore(size_t offset);
+
+  // compare world's state hash to recorded one
+  void checkHash();
+};
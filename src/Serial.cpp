@@ -0,0 +1,58 @@
+#include "Serial.h"
+
+using namespace std;
+
+namespace Serial
+{
+  void writeActions(Writer &w, int frame, int player, const map<int, Action> &actions)
+  {
+    size_t at = w.begin(ACTIONS);
+    w.put(ActionsHeader{ frame, player, static_cast<int32_t>(actions.size()) });
+
+    char *p = w.extend(actions.size() * sizeof(ActionRecord));
+
+    for (const auto &a : actions) {
+      ActionRecord r;
+      r.unitId = a.first;
+      r.type = a.second.type;
+      r.attackTargetId = a.second.type == Action::ATTACK ? a.second.attackTargetId : -1;
+      r.x = a.second.movePos.x;
+      r.y = a.second.movePos.y;
+      memcpy(p, &r, sizeof(r));
+      p += sizeof(r);
+    }
+
+    w.finish(at);
+  }
+
+  void readActions(Reader &r, int &frame, int &player, vector<pair<int, Action>> &actions)
+  {
+    ActionsHeader h;
+    r.get(h);
+
+    if (h.count < 0 || h.player < 0 || h.player > 1) {
+      ERR("Serial: bad actions header");
+    }
+
+    frame = h.frame;
+    player = h.player;
+    actions.resize(static_cast<size_t>(h.count));
+
+    const char *p = r.skip(static_cast<size_t>(h.count) * sizeof(ActionRecord));
+
+    for (auto &a : actions) {
+      ActionRecord rec;
+      memcpy(&rec, p, sizeof(rec));
+      p += sizeof(rec);
+
+      if (rec.type < Action::NOP || rec.type > Action::STOP) {
+        ERR("Serial: bad action type " << rec.type);
+      }
+
+      a.first = rec.unitId;
+      a.second.type = static_cast<Action::Type>(rec.type);
+      a.second.attackTargetId = rec.attackTargetId;
+      a.second.movePos = Vec2(rec.x, rec.y);
+    }
+  }
+}
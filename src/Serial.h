@@ -0,0 +1,237 @@
+#pragma once
+
+// versioned fixed-layout binary encoding of world states and actions
+//
+// a stream is a sequence of chunks: Header followed by header.size bytes
+// of payload, so readers can skip chunks they don't know; all fields are
+// stored in host byte order (little endian on x86) and copied with memcpy
+//
+// STATE payload:  StateHeader, params (paramsLength chars), rng state
+//                 (rngSize bytes), free unit ids (int32 each), unitCount
+//                 UnitRecords in slot order
+// ACTIONS payload: ActionsHeader, count ActionRecords (increasing unit id)
+// REPLAY payload: ReplayHeader, game spec (specLength chars, csim options)
+// END payload:    int32 frame count
+// HASHES payload: HashesHeader, count uint64 world state hashes (after
+//                 frame, frame+1, ... frames)
+//
+// payloads of STATE, ACTIONS, END, and HASHES start with the int32 frame they
+// belong to (replays are ordered by it, see Replay.h)
+//
+// bump VERSION when a layout changes
+
+#include "Global.h"
+#include "Action.h"
+#include <cstring>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace Serial
+{
+  constexpr uint32_t MAGIC = 0x4d495343; // "CSIM"
+  constexpr uint32_t VERSION = 2;
+
+  enum Kind : uint32_t { STATE = 1, ACTIONS = 2, REPLAY = 3, END = 4, HASHES = 5 };
+
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t kind;
+    uint32_t size;  // payload bytes
+  };
+
+  struct StateHeader
+  {
+    int32_t frame;          // World frame counter
+    int32_t storeFrame;     // UnitStore frame (motion steps)
+    int32_t timerFrame;     // frame up to which unit timers have expired
+    float   width, height;
+    uint8_t fogOfWar;
+    uint8_t pad[3];
+    float   maxRadius[2];   // of units ever added, per player
+    float   maxVisionRange[2];
+    int32_t unitCount;
+    int32_t ownerCount0;    // units of player 0 (first in slot order)
+    int32_t idBound;        // all unit ids handed out so far are < idBound
+    int32_t freeIdCount;
+    uint32_t paramsLength;
+    uint32_t rngSize;
+    int32_t seed;           // World seed (keys of unit draws)
+  };
+
+  // Unit with absolute motion / cooldown frames (see UnitStore)
+  struct UnitRecord
+  {
+    int32_t unitId, type, owner;
+    int32_t hp, arrivesAt, readyAt;
+    int32_t maxHp, attack, cooldown;
+    float   x, y, dx, dy, tx, ty;
+    float   radius, maxSpeed, visionRange, attackRange;
+    uint8_t onlyAttackWhenStopped;
+    uint8_t readyReported, idleReported; // UnitStore flags
+    uint8_t pad;
+  };
+
+  struct ActionsHeader
+  {
+    int32_t frame;
+    int32_t player;
+    int32_t count;
+  };
+
+  struct ActionRecord
+  {
+    int32_t unitId;
+    int32_t type;
+    int32_t attackTargetId;
+    float   x, y;
+  };
+
+  struct ReplayHeader
+  {
+    int32_t keyframeInterval;
+    uint32_t specLength;
+  };
+
+  struct HashesHeader
+  {
+    int32_t frame;
+    int32_t count;
+  };
+
+  static_assert(sizeof(Header) == 16, "layout");
+  static_assert(sizeof(StateHeader) == 68, "layout");
+  static_assert(sizeof(UnitRecord) == 80, "layout");
+  static_assert(sizeof(ActionsHeader) == 12, "layout");
+  static_assert(sizeof(ActionRecord) == 20, "layout");
+  static_assert(sizeof(ReplayHeader) == 8, "layout");
+  static_assert(sizeof(HashesHeader) == 8, "layout");
+  static_assert(std::is_trivially_copyable<KeyedRNG>::value, "rng state is copied bytewise");
+
+  // appends to a byte buffer (which keeps its capacity when cleared)
+  class Writer
+  {
+  public:
+
+    explicit Writer(std::vector<char> &buf_) : buf(buf_) { }
+
+    size_t size() const { return buf.size(); }
+
+    // n uninitialized bytes at the end
+    char *extend(size_t n)
+    {
+      size_t s = buf.size();
+      buf.resize(s + n);
+      return buf.data() + s;
+    }
+
+    template <typename T>
+    void put(const T *p, size_t n)
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "bytewise copy");
+      if (n) {
+        memcpy(extend(n * sizeof(T)), p, n * sizeof(T));
+      }
+    }
+
+    template <typename T>
+    void put(const T &v) { put(&v, 1); }
+
+    // replace bytes at offset at (written before) by v
+    template <typename T>
+    void overwrite(size_t at, const T &v)
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "bytewise copy");
+      assert(at + sizeof(T) <= buf.size());
+      memcpy(buf.data() + at, &v, sizeof(T));
+    }
+
+    // header of a chunk whose payload follows; finish() fills in its size
+    size_t begin(Kind kind)
+    {
+      size_t at = buf.size();
+      put(Header{ MAGIC, VERSION, kind, 0 });
+      return at;
+    }
+
+    void finish(size_t at)
+    {
+      Header h;
+      memcpy(&h, buf.data() + at, sizeof(h));
+      h.size = static_cast<uint32_t>(buf.size() - at - sizeof(h));
+      overwrite(at, h);
+    }
+
+  private:
+
+    std::vector<char> &buf;
+  };
+
+  // reads from a byte range; running past its end is an error
+  class Reader
+  {
+  public:
+
+    Reader(const char *first_, const char *last_) : p(first_), last(last_) { }
+
+    explicit Reader(const std::vector<char> &buf) : Reader(buf.data(), buf.data() + buf.size()) { }
+
+    bool atEnd() const { return p == last; }
+    const char *pos() const { return p; }
+    size_t remaining() const { return static_cast<size_t>(last - p); }
+
+    // next n bytes
+    const char *skip(size_t n)
+    {
+      if (n > remaining()) {
+        ERR("Serial: unexpected end of data");
+      }
+      const char *q = p;
+      p += n;
+      return q;
+    }
+
+    template <typename T>
+    void get(T *q, size_t n)
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "bytewise copy");
+      if (n) {
+        memcpy(q, skip(n * sizeof(T)), n * sizeof(T));
+      }
+    }
+
+    template <typename T>
+    void get(T &v) { get(&v, 1); }
+
+    // chunk header, checked
+    Header header()
+    {
+      Header h;
+      get(h);
+      if (h.magic != MAGIC) {
+        ERR("Serial: bad magic number");
+      }
+      if (h.version != VERSION) {
+        ERR("Serial: unsupported version " << h.version << " (expected " << VERSION << ")");
+      }
+      if (h.size > remaining()) {
+        ERR("Serial: truncated chunk");
+      }
+      return h;
+    }
+
+  private:
+
+    const char *p, *last;
+  };
+
+  // actions of a player in a frame as ACTIONS chunk
+  void writeActions(Writer &w, int frame, int player, const std::map<int, Action> &actions);
+
+  // reads ACTIONS payload (after its header) => actions (cleared first)
+  void readActions(Reader &r, int &frame, int &player,
+                   std::vector<std::pair<int, Action>> &actions);
+}
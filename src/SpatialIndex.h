@@ -0,0 +1,234 @@
+#pragma once
+
+// runtime selectable spatial index over points
+// dispatches to Quadtree or Grid (same interface) or LinearQuadtree;
+// BF means no index is maintained and callers scan all points instead
+//
+// Quadtree and Grid are maintained incrementally (remove/update/rebind);
+// LinearQuadtree is not (isIncremental() == false) and must be rebuilt
+// with build() whenever points have moved or disappeared
+
+#include "Global.h"
+#include "Quadtree.h"
+#include "Grid.h"
+#include "LinearQuadtree.h"
+#include <string>
+#include <utility>
+
+struct SpatialParams
+{
+  enum Type { BF = 0, QT, GRID, LQT };
+
+  SpatialParams(Type type_ = QT, fp_t qtEps_ = 800, fp_t cellSize_ = 320, bool autoEps_ = false)
+    : type(type_), qtEps(qtEps_), cellSize(cellSize_), autoEps(autoEps_)
+  {
+    // qtEps 0 has always meant "no quadtree"
+    if (type == QT && qtEps <= 0 && !autoEps) {
+      type = BF;
+    }
+  }
+
+  Type type;
+  fp_t qtEps;     // quadtree split epsilon
+  fp_t cellSize;  // grid cell side length
+  bool autoEps;   // world tunes qtEps and type (see SpatialTuner)
+
+  bool useIndex() const { return type != BF; }
+
+  static std::string typeToString(Type t)
+  {
+    switch (t) {
+      case BF:   return "bf";
+      case QT:   return "qt";
+      case GRID: return "grid";
+      case LQT:  return "lqt";
+    }
+    ERR("SpatialParams: unknown type " << t);
+  }
+
+  static Type typeFromString(const std::string &s)
+  {
+    if (s == "bf") {
+      return BF;
+    } else if (s == "qt") {
+      return QT;
+    } else if (s == "grid") {
+      return GRID;
+    } else if (s == "lqt") {
+      return LQT;
+    }
+    ERR("SpatialParams: unknown type '" << s << "'");
+  }
+};
+
+
+template <typename Point>
+class SpatialIndex
+{
+public:
+
+  using Coor = decltype(std::declval<const Point&>().getX());
+
+  SpatialIndex()
+  {
+    type = SpatialParams::BF;
+  }
+
+  // coordinates [0..width), [0..height) accepted
+  void setup(const SpatialParams &params, Coor width, Coor height)
+  {
+    type = params.type;
+
+    switch (type) {
+      case SpatialParams::BF:   break;
+      case SpatialParams::QT:   qt.setup(width, height, params.qtEps); break;
+      case SpatialParams::GRID: grid.setup(width, height, params.cellSize); break;
+      case SpatialParams::LQT:  lqt.setup(width, height); break;
+    }
+  }
+
+  SpatialParams::Type getType() const { return type; }
+
+  // false: remove/update/rebind are ignored, use build() instead
+  bool isIncremental() const { return type != SpatialParams::LQT; }
+
+  // clear and insert all points
+  void build(Span<Point> points)
+  {
+    clear();
+    for (const Point &p : points) {
+      insert(&p);
+    }
+    if (type == SpatialParams::LQT) {
+      lqt.build();
+    }
+  }
+
+  void clear()
+  {
+    switch (type) {
+      case SpatialParams::BF:   break;
+      case SpatialParams::QT:   qt.clear(); break;
+      case SpatialParams::GRID: grid.clear(); break;
+      case SpatialParams::LQT:  lqt.clear(); break;
+    }
+  }
+
+  void insert(const Point *pp)
+  {
+    switch (type) {
+      case SpatialParams::BF:   break;
+      case SpatialParams::QT:   qt.insert(pp); break;
+      case SpatialParams::GRID: grid.insert(pp); break;
+      case SpatialParams::LQT:  lqt.insert(pp); break;
+    }
+  }
+
+  // @return true if found
+  bool remove(const Point *pp)
+  {
+    switch (type) {
+      case SpatialParams::BF:   return true;
+      case SpatialParams::QT:   return qt.remove(pp);
+      case SpatialParams::GRID: return grid.remove(pp);
+      case SpatialParams::LQT:  return true;
+    }
+    return false;
+  }
+
+  // pp moved from (oldX, oldY) to its current coordinates
+  // @return false if not found
+  bool update(const Point *pp, Coor oldX, Coor oldY)
+  {
+    switch (type) {
+      case SpatialParams::BF:   return true;
+      case SpatialParams::QT:   return qt.update(pp, oldX, oldY);
+      case SpatialParams::GRID: return grid.update(pp, oldX, oldY);
+      case SpatialParams::LQT:  return true;
+    }
+    return false;
+  }
+
+  // point data moved from oldP to newP
+  // @return false if not found
+  bool rebind(const Point *oldP, const Point *newP)
+  {
+    switch (type) {
+      case SpatialParams::BF:   return true;
+      case SpatialParams::QT:   return qt.rebind(oldP, newP);
+      case SpatialParams::GRID: return grid.rebind(oldP, newP);
+      case SpatialParams::LQT:  return true;
+    }
+    return false;
+  }
+
+  // points in [xMin, xMax) x [yMin, yMax)
+  void query(Coor xMin, Coor xMax, Coor yMin, Coor yMax, std::vector<const Point*> &result) const
+  {
+    switch (type) {
+      case SpatialParams::BF:   ERR("SpatialIndex: query without index");
+      case SpatialParams::QT:   qt.query(xMin, xMax, yMin, yMax, result); break;
+      case SpatialParams::GRID: grid.query(xMin, xMax, yMin, yMax, result); break;
+      case SpatialParams::LQT:  lqt.query(xMin, xMax, yMin, yMax, result); break;
+    }
+  }
+
+  // @return true if f(p) is true for a point p in [xMin, xMax) x [yMin, yMax)
+  // (stops at first hit)
+  template <typename F>
+  bool any(Coor xMin, Coor xMax, Coor yMin, Coor yMax, F f) const
+  {
+    switch (type) {
+      case SpatialParams::BF:   ERR("SpatialIndex: query without index");
+      case SpatialParams::QT:   return qt.any(xMin, xMax, yMin, yMax, f);
+      case SpatialParams::GRID: return grid.any(xMin, xMax, yMin, yMax, f);
+      case SpatialParams::LQT:  return lqt.any(xMin, xMax, yMin, yMax, f);
+    }
+    return false;
+  }
+
+  // points p with dist2((x, y), p) < r^2
+  void queryCircle(Coor x, Coor y, Coor r, std::vector<const Point*> &result) const
+  {
+    switch (type) {
+      case SpatialParams::BF:   ERR("SpatialIndex: query without index");
+      case SpatialParams::QT:   qt.queryCircle(x, y, r, result); break;
+      case SpatialParams::GRID: grid.queryCircle(x, y, r, result); break;
+      case SpatialParams::LQT:  lqt.queryCircle(x, y, r, result); break;
+    }
+  }
+
+  // number of heap allocations since last clear()
+  size_t getAllocs() const
+  {
+    switch (type) {
+      case SpatialParams::BF:   return 0;
+      case SpatialParams::QT:   return qt.getAllocs();
+      case SpatialParams::GRID: return grid.getAllocs();
+      case SpatialParams::LQT:  return lqt.getAllocs();
+    }
+    return 0;
+  }
+
+  // memory footprint of index (0 for BF)
+  size_t getBytes() const
+  {
+    switch (type) {
+      case SpatialParams::BF:   return 0;
+      case SpatialParams::QT:   return qt.getBytes();
+      case SpatialParams::GRID: return grid.getBytes();
+      case SpatialParams::LQT:  return lqt.getBytes();
+    }
+    return 0;
+  }
+
+  const Quadtree<Point> &getQuadtree() const { return qt; }
+  const Grid<Point> &getGrid() const { return grid; }
+
+private:
+
+  SpatialParams::Type type;
+  Quadtree<Point> qt;
+  Grid<Point> grid;
+  LinearQuadtree<Point> lqt;
+};
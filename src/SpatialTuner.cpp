@@ -0,0 +1,165 @@
+#include "SpatialTuner.h"
+
+using namespace std;
+
+SpatialTuner::SpatialTuner()
+{
+  width = height = 1;
+  queryRange = 0;
+  baseType = SpatialParams::QT;
+  minEps = maxEps = 1;
+  started = false;
+  frames = 0;
+  totalMicros = 0;
+  probe = -1;
+  holdEpochs = 0;
+}
+
+void SpatialTuner::setup(const SpatialParams &params, fp_t width_, fp_t height_)
+{
+  width = width_;
+  height = height_;
+  queryRange = 0;
+
+  // brute force isn't a base type: eps auto means qt (with possible
+  // switch to bf)
+  baseType = params.type == SpatialParams::BF ? SpatialParams::QT : params.type;
+
+  minEps = 1;
+  maxEps = std::max(width, height);
+  started = false;
+  frames = 0;
+  totalMicros = 0;
+  candidates.clear();
+  costs.clear();
+  probe = -1;
+  holdEpochs = 0;
+}
+
+bool SpatialTuner::dense() const
+{
+  return square(2*queryRange) >= BF_FRACTION * width * height;
+}
+
+SpatialParams SpatialTuner::withEps(const SpatialParams &p, fp_t eps) const
+{
+  SpatialParams q = p;
+  q.type = baseType;
+  q.qtEps = std::min(std::max(eps, minEps), maxEps);
+  return q;
+}
+
+void SpatialTuner::startRound(const SpatialParams &current)
+{
+  candidates.clear();
+  costs.clear();
+  candidates.push_back(current);
+
+  if (current.type == SpatialParams::BF) {
+
+    // try index again
+    candidates.push_back(withEps(current, current.qtEps));
+
+  } else {
+
+    if (baseType == SpatialParams::QT) {
+      if (current.qtEps * 2 <= maxEps) {
+        candidates.push_back(withEps(current, current.qtEps * 2));
+      }
+      if (current.qtEps / 2 >= minEps) {
+        candidates.push_back(withEps(current, current.qtEps / 2));
+      }
+    }
+
+    if (dense()) {
+      SpatialParams bf = current;
+      bf.type = SpatialParams::BF;
+      candidates.push_back(bf);
+    }
+  }
+
+  probe = 0;
+}
+
+bool SpatialTuner::update(Span<Unit> units, sint8 micros, SpatialParams &params)
+{
+  if (!started) {
+
+    if (units.empty()) {
+      return false;
+    }
+
+    started = true;
+
+    for (const Unit &u : units) {
+      queryRange = std::max(queryRange, u.attackRange + u.radius);
+    }
+
+    // leaves much smaller than queries don't pay off
+    minEps = std::max(queryRange / 4, 1.0f);
+
+    // initial eps from density: LEAF_TARGET units per eps-square
+    fp_t eps = sqrt(LEAF_TARGET * width * height / static_cast<fp_t>(units.size()));
+    params = withEps(params, eps);
+    DPRINT("tuner: initial eps " << params.qtEps);
+    startRound(params);
+    return true;
+  }
+
+  ++frames;
+  if (frames > SETTLE) {
+    totalMicros += micros;
+  }
+
+  if (frames < EPOCH) {
+    return false;
+  }
+
+  double cost = static_cast<double>(totalMicros) / (frames - SETTLE);
+  frames = 0;
+  totalMicros = 0;
+
+  if (probe < 0) {
+
+    // holding
+
+    if (--holdEpochs > 0) {
+      return false;
+    }
+
+    startRound(params);
+  }
+
+  costs.push_back(cost);
+  ++probe;
+
+  if (probe < static_cast<int>(candidates.size())) {
+    params = candidates[static_cast<size_t>(probe)];
+    return true;
+  }
+
+  // round done: keep best candidate if it's clearly better than old setting
+
+  size_t best = 0;
+
+  for (size_t i=1; i < costs.size(); ++i) {
+    if (costs[i] < costs[best]) {
+      best = i;
+    }
+  }
+
+  if (costs[best] > costs[0] * (1 - MIN_GAIN)) {
+    best = 0;
+  }
+
+  DPRINT("tuner: " << SpatialParams::typeToString(candidates[best].type)
+         << " eps " << candidates[best].qtEps << " cost " << costs[best]);
+
+  probe = -1;
+  holdEpochs = HOLD_EPOCHS;
+
+  bool changed =
+    params.type != candidates[best].type || params.qtEps != candidates[best].qtEps;
+  params = candidates[best];
+  return changed;
+}
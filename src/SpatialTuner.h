@@ -0,0 +1,67 @@
+#pragma once
+
+// adaptive choice of spatial index parameters (--qteps auto)
+//
+// the initial quadtree split epsilon is derived from unit density (about
+// LEAF_TARGET points per eps-square); afterwards the tuner measures the
+// frame cost (views + players + action execution) of the current setting
+// over an epoch of frames, probes eps*2, eps/2 and - in dense worlds,
+// where queries return a large fraction of all units - brute force for
+// one epoch each, and keeps the cheapest; probing is repeated every
+// HOLD_EPOCHS epochs because density changes as units die
+//
+// the choice only affects speed: query result order depends on the index,
+// but every target selection (range kernels, *TargetIndexes, quadtree
+// nearest search) breaks ties by unitId, so games don't
+
+#include "Global.h"
+#include "SpatialIndex.h"
+#include "Unit.h"
+
+class SpatialTuner
+{
+public:
+
+  SpatialTuner();
+
+  // params: initial setting (base type and cell size are kept)
+  void setup(const SpatialParams &params, fp_t width, fp_t height);
+
+  // called once per frame with all units and micro seconds spent in the
+  // frame
+  // @return true if params were changed (=> indexes must be set up again)
+  bool update(Span<Unit> units, sint8 micros, SpatialParams &params);
+
+private:
+
+  static constexpr int LEAF_TARGET = 16;   // points per leaf for initial eps
+  static constexpr int EPOCH = 16;         // frames per measurement
+  static constexpr int SETTLE = 2;         // frames skipped after change
+  static constexpr int HOLD_EPOCHS = 8;    // epochs between probing rounds
+  static constexpr double MIN_GAIN = 0.05; // relative gain needed to switch
+  static constexpr fp_t BF_FRACTION = 1.0f / 32; // query area / map area
+
+  fp_t width, height;
+  fp_t queryRange;           // max. attack range + radius
+  SpatialParams::Type baseType;
+  fp_t minEps, maxEps;
+  bool started;
+
+  // current measurement
+  int frames;
+  sint8 totalMicros;
+
+  // probing round: candidates[0] is the setting in use before the round
+  std::vector<SpatialParams> candidates;
+  std::vector<double> costs; // avg. micros per frame
+  int probe;                 // candidate being measured, -1: holding
+  int holdEpochs;
+
+  // fraction of all units a typical query covers
+  bool dense() const;
+
+  // start probing round from current setting
+  void startRound(const SpatialParams &current);
+
+  SpatialParams withEps(const SpatialParams &p, fp_t eps) const;
+};
@@ -0,0 +1,198 @@
+#pragma once
+
+// fixed pool of worker threads for fork-join loops
+//
+// run(n, f) calls f(i) for i in [0, n) on the workers and the calling
+// thread and returns when all calls are done; with 1 thread everything runs
+// on the caller, in index order
+//
+// work stealing: each thread starts with a contiguous block of indexes
+// which it handles front to back; a thread that runs out takes the back
+// half of another thread's remaining block, so uneven tasks balance out
+// while neighbouring indexes mostly stay on the same thread
+
+#include "Global.h"
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+
+  // threads: including the calling thread
+  explicit ThreadPool(int threads = 1)
+    : blocks(static_cast<size_t>(std::max(threads, 1)))
+  {
+    if (threads < 1) {
+      ERR("ThreadPool: need at least one thread");
+    }
+
+    for (int i=1; i < threads; ++i) {
+      workers.emplace_back([this, i] { work(i); });
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+    }
+    wake.notify_all();
+
+    for (auto &t : workers) {
+      t.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  int getThreads() const { return static_cast<int>(workers.size()) + 1; }
+
+  void run(int n, const std::function<void(int)> &f)
+  {
+    run(n, [&f](int i, int /*thread*/) { f(i); });
+  }
+
+  // f(i, thread): thread in [0, getThreads()) identifies the calling thread
+  // (0: caller), e.g. to select per-thread buffers
+  void run(int n, const std::function<void(int, int)> &f)
+  {
+    if (workers.empty() || n <= 1) {
+      for (int i=0; i < n; ++i) {
+        f(i, 0);
+      }
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job = &f;
+
+      int t = getThreads();
+      for (int k=0; k < t; ++k) {
+        Block &b = blocks[static_cast<size_t>(k)];
+        std::lock_guard<std::mutex> blockLock(b.mutex);
+        b.begin = static_cast<int>(static_cast<long>(n) * k / t);
+        b.end   = static_cast<int>(static_cast<long>(n) * (k+1) / t);
+      }
+
+      busy = static_cast<int>(workers.size());
+      ++generation;
+    }
+    wake.notify_all();
+
+    loop(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+    job = nullptr;
+  }
+
+private:
+
+  // indexes [begin, end) not handed out yet, one block per thread
+  struct alignas(64) Block
+  {
+    std::mutex mutex;
+    int begin = 0, end = 0;
+  };
+
+  std::vector<Block> blocks;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake, done;
+  const std::function<void(int, int)> *job = nullptr;
+  int busy = 0;              // workers still in current job
+  unsigned generation = 0;   // counts jobs
+  bool quit = false;
+
+  // next index of own block
+  bool pop(int thread, int &i)
+  {
+    Block &b = blocks[static_cast<size_t>(thread)];
+    std::lock_guard<std::mutex> lock(b.mutex);
+
+    if (b.begin >= b.end) {
+      return false;
+    }
+    i = b.begin++;
+    return true;
+  }
+
+  // move back half of another thread's block to own (empty) block
+  bool steal(int thread)
+  {
+    int t = getThreads();
+
+    for (int k=1; k < t; ++k) {
+
+      Block &victim = blocks[static_cast<size_t>((thread + k) % t)];
+      int begin, end;
+
+      {
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.begin >= victim.end) {
+          continue;
+        }
+        end = victim.end;
+        begin = victim.end = victim.begin + (victim.end - victim.begin) / 2;
+      }
+
+      Block &own = blocks[static_cast<size_t>(thread)];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      own.begin = begin;
+      own.end = end;
+      return true;
+    }
+    return false;
+  }
+
+  // tasks don't create tasks => done when all blocks are empty
+  void loop(int thread)
+  {
+    const std::function<void(int, int)> &f = *job;
+
+    for (;;) {
+      int i;
+      if (pop(thread, i)) {
+        f(i, thread);
+      } else if (!steal(thread)) {
+        return;
+      }
+    }
+  }
+
+  void work(int thread)
+  {
+    unsigned seen = 0;
+
+    for (;;) {
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return quit || generation != seen; });
+
+        if (quit) {
+          return;
+        }
+
+        seen = generation;
+      }
+
+      loop(thread);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0) {
+          done.notify_one();
+        }
+      }
+    }
+  }
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+// hierarchical timer wheel keyed by frame number
+//
+// LEVELS wheels of 64 slots each; level l holds timers whose frame agrees
+// with the current frame in all bits above 6*(l+1) and differs in bits
+// [6*l, 6*(l+1)); when the current frame enters a new level-l period, the
+// timers of the matching level-l slot are re-inserted one level lower
+// (cascade), so each timer moves at most LEVELS times and advancing by one
+// frame costs O(1) plus the timers that expire
+//
+// timers beyond the top level (2^24 frames ahead) wait in an overflow list
+// which is re-inserted when the top level wraps
+//
+// there is no cancellation - owners check whether an expired timer is still
+// relevant (lazy deletion)
+
+#include "Global.h"
+#include <array>
+#include <vector>
+
+template <typename T>
+class TimerWheel
+{
+public:
+
+  static constexpr int LEVELS = 4;
+  static constexpr int BITS = 6;
+  static constexpr int SLOTS = 1 << BITS;
+
+  TimerWheel()
+  {
+    clear();
+  }
+
+  // remove all timers, current frame := frame
+  void clear(int frame = -1)
+  {
+    for (auto &level : wheels) {
+      for (auto &slot : level) {
+        slot.clear();
+      }
+    }
+    overflow.clear();
+    now = frame;
+    size = 0;
+  }
+
+  // frame up to which timers have expired
+  int getFrame() const { return now; }
+
+  size_t getSize() const { return size; }
+
+  // t expires when frame is reached (frame > getFrame())
+  void schedule(int frame, const T &t)
+  {
+    assert(frame > now);
+    insert({ frame, t });
+    ++size;
+  }
+
+  // advance to frame, appending expired timers to due (in expiry order)
+  void advance(int frame, std::vector<T> &due)
+  {
+    while (now < frame) {
+
+      ++now;
+
+      // cascade, highest level first
+
+      if (low(now, LEVELS*BITS) == 0) {
+        reinsert(overflow);
+      }
+
+      for (int l=LEVELS-1; l > 0; --l) {
+        if (low(now, l*BITS) == 0) {
+          reinsert(wheels[static_cast<size_t>(l)][slotIndex(now, l)]);
+        }
+      }
+
+      auto &slot = wheels[0][slotIndex(now, 0)];
+
+      for (const Entry &e : slot) {
+        assert(e.frame == now);
+        due.push_back(e.data);
+      }
+      size -= slot.size();
+      slot.clear();
+    }
+  }
+
+private:
+
+  struct Entry
+  {
+    int frame;
+    T data;
+  };
+
+  std::array<std::array<std::vector<Entry>, SLOTS>, LEVELS> wheels;
+  std::vector<Entry> overflow;
+  std::vector<Entry> cascade; // scratch
+  int now;
+  size_t size;
+
+  static unsigned low(int frame, int bits)
+  {
+    return static_cast<unsigned>(frame) & ((1u << bits) - 1);
+  }
+
+  static size_t slotIndex(int frame, int level)
+  {
+    return (static_cast<unsigned>(frame) >> (level*BITS)) & (SLOTS-1);
+  }
+
+  void insert(const Entry &e)
+  {
+    // lowest level whose period contains e.frame
+    unsigned diff = static_cast<unsigned>(e.frame) ^ static_cast<unsigned>(now);
+
+    for (int l=0; l < LEVELS; ++l) {
+      if ((diff >> ((l+1)*BITS)) == 0) {
+        wheels[static_cast<size_t>(l)][slotIndex(e.frame, l)].push_back(e);
+        return;
+      }
+    }
+    overflow.push_back(e);
+  }
+
+  void reinsert(std::vector<Entry> &list)
+  {
+    cascade.swap(list);
+    for (const Entry &e : cascade) {
+      insert(e);
+    }
+    cascade.clear();
+  }
+};
@@ -1,3 +0,0 @@
-#include "Unit.h"
-
-int Unit::id = 0;
@@ -6,10 +6,7 @@
 
 struct Unit
 {
-  // id increases with every constructor call
-  // careful: only create new units via construction
-  
-  static int id; 
+  // unitId is assigned by World::addUnit (-1 until then)
   
   Unit(int owner_ = -1, const Vec2 &pos_ = { 0, 0 })
     : owner(owner_), pos(pos_)
@@ -23,7 +20,7 @@ struct Unit
     cooldown = 0;
     onlyAttackWhenStopped = true;
 
-    unitId = ++id;
+    unitId = -1;
     type = -1;
 
     alive = true;
@@ -0,0 +1,758 @@
+#include "UnitStore.h"
+#include "RangeKernels.h"
+#include <algorithm>
+
+#if defined(__x86_64__)
+#define UNIT_STORE_X86 1
+#include <immintrin.h>
+#else
+#define UNIT_STORE_X86 0
+#endif
+
+using namespace std;
+
+void UnitStore::clear()
+{
+  units.clear();
+  id2slot.clear();
+  pos.clear();
+  delta.clear();
+  targetPos.clear();
+  arrivesAt.clear();
+  hp.clear();
+  readyAt.clear();
+  radius.clear();
+  readyFlags.resize(0);
+  idleFlags.resize(0);
+  hashes.clear();
+  stateHash = 0;
+  ownerCounts = { 0, 0 };
+  maxRadius = { 0, 0 };
+  maxVisionRange = { 0, 0 };
+  now = 0;
+  timers.clear();
+}
+
+void UnitStore::pushSlot()
+{
+  units.emplace_back();
+  pos.emplace_back();
+  delta.emplace_back();
+  targetPos.emplace_back();
+  arrivesAt.emplace_back();
+  hp.emplace_back();
+  readyAt.emplace_back();
+  radius.emplace_back();
+  hashes.emplace_back();
+  readyFlags.grow(units.size());
+  idleFlags.grow(units.size());
+}
+
+void UnitStore::popSlot()
+{
+  units.pop_back();
+  pos.pop_back();
+  delta.pop_back();
+  targetPos.pop_back();
+  arrivesAt.pop_back();
+  hp.pop_back();
+  readyAt.pop_back();
+  radius.pop_back();
+  hashes.pop_back();
+  readyFlags.reset(units.size());
+  idleFlags.reset(units.size());
+}
+
+void UnitStore::copySlot(size_t to, size_t from, Relocations &rel)
+{
+  assert(rel.n < 2);
+  rel.from[static_cast<size_t>(rel.n)] = static_cast<int>(from);
+  rel.to[static_cast<size_t>(rel.n)] = static_cast<int>(to);
+  ++rel.n;
+
+  units[to]         = units[from];
+  pos[to]           = pos[from];
+  delta[to]         = delta[from];
+  targetPos[to]     = targetPos[from];
+  arrivesAt[to]     = arrivesAt[from];
+  hp[to]            = hp[from];
+  readyAt[to]       = readyAt[from];
+  radius[to]        = radius[from];
+  hashes[to]        = hashes[from];
+  readyFlags.assign(to, readyFlags.test(from));
+  idleFlags.assign(to, idleFlags.test(from));
+
+  id2slot[static_cast<size_t>(units[to].unitId)] = static_cast<int>(to);
+}
+
+void UnitStore::add(const Unit &u)
+{
+  assert(u.unitId >= 0);
+  assert(u.owner == 0 || u.owner == 1);
+
+  size_t id = static_cast<size_t>(u.unitId);
+
+  if (id >= id2slot.size()) {
+    id2slot.resize(id+1, -1);
+  }
+
+  if (id2slot[id] >= 0) {
+    ERR("UnitStore: duplicate unit id " << u.unitId);
+  }
+
+  pushSlot();
+
+  size_t i = units.size()-1;
+
+  if (u.owner == 0 && ownerCounts[1] > 0) {
+    // make room at end of player 0 partition by moving
+    // first player 1 unit to the end
+    Relocations rel;
+    i = static_cast<size_t>(ownerCounts[0]);
+    copySlot(units.size()-1, i, rel);
+  }
+
+  units[i]         = u;
+  pos[i]           = u.pos;
+  delta[i]         = u.delta;
+  targetPos[i]     = u.targetPos;
+  arrivesAt[i]     = now + u.moveCount;
+  hp[i]            = u.hp;
+  readyAt[i]       = now + u.cooldownCount;
+  radius[i]        = u.radius;
+  id2slot[id]      = static_cast<int>(i);
+  readyFlags.reset(i);
+  idleFlags.reset(i);
+  hashes[i]        = unitHash(i);
+  stateHash       += hashes[i];
+
+  // reported by the next expireTimers() call at the earliest
+  int next = timers.getFrame()+1;
+  timers.schedule(std::max(readyAt[i], next), { u.unitId, READY });
+  timers.schedule(std::max(arrivesAt[i], next), { u.unitId, ARRIVAL });
+
+  size_t owner = static_cast<size_t>(u.owner);
+  ++ownerCounts[owner];
+  maxRadius[owner] = std::max(maxRadius[owner], u.radius);
+  maxVisionRange[owner] = std::max(maxVisionRange[owner], u.visionRange);
+}
+
+UnitStore::Relocations UnitStore::remove(int slot)
+{
+  assert(slot >= 0 && slot < size());
+
+  Relocations rel;
+  size_t hole = static_cast<size_t>(slot);
+  size_t owner = static_cast<size_t>(units[hole].owner);
+
+  id2slot[static_cast<size_t>(units[hole].unitId)] = -1;
+  stateHash -= hashes[hole];
+
+  if (owner == 0) {
+
+    // fill hole with last player 0 unit, which leaves
+    // a hole at the partition boundary
+    
+    size_t last0 = static_cast<size_t>(ownerCounts[0]-1);
+
+    if (hole != last0) {
+      copySlot(hole, last0, rel);
+    }
+    hole = last0;
+  }
+
+  size_t last = units.size()-1;
+
+  if (hole != last) {
+    copySlot(hole, last, rel);
+  }
+
+  popSlot();
+  --ownerCounts[owner];
+  return rel;
+}
+
+void UnitStore::publish()
+{
+  for (int i=0; i < size(); ++i) {
+    publish(i);
+  }
+}
+
+void UnitStore::startMotion(int slot, const Vec2 &whereTo)
+{
+  size_t i = static_cast<size_t>(slot);
+
+  DPRINT("world: start motion " << units[i].unitId);
+
+  fp_t speed = units[i].maxSpeed;
+  fp_t d = static_cast<fp_t>(sqrt(whereTo.dist2(pos[i])));
+  fp_t time = d / speed;
+
+  if (time >= 100'000) {
+    ERR("motion too slow");
+  }
+
+  int frames = static_cast<int>(ceil(time));
+
+  if (!frames) {
+    stopMotion(slot);
+    return;
+  }
+
+  assert(time > 0);
+
+  arrivesAt[i] = now + frames;
+  idleFlags.reset(i);
+  timers.schedule(arrivesAt[i], { units[i].unitId, ARRIVAL });
+
+  targetPos[i] = whereTo;
+  delta[i] = whereTo.sub(pos[i]);
+  delta[i].scale(static_cast<fp_t>(1.0/time));
+  rehash(i);
+}
+
+// @return true if unit in toSlot is dead
+bool UnitStore::executeAttack(int fromSlot, int toSlot, int cooldownDelta)
+{
+  assert(readyForAttack(fromSlot));
+
+  size_t f = static_cast<size_t>(fromSlot);
+  size_t t = static_cast<size_t>(toSlot);
+
+  hp[t] -= units[f].attack;
+  // randomize cooldown -1..+2
+  // note: +1 because the frame advances at the end of this frame
+  readyAt[f] = now + std::max((units[f].cooldown+1)+cooldownDelta, 1);
+  readyFlags.reset(f);
+  timers.schedule(readyAt[f], { units[f].unitId, READY });
+  rehash(f);
+  rehash(t);
+  return hp[t] <= 0;
+}
+
+
+/* motion
+
+   scalar code is the reference: the vector versions evaluate the same float
+   operations per coordinate - x and y of a unit are adjacent lanes, the
+   collision time is the minimum over both - so positions are bit-identical
+*/
+
+bool UnitStore::moveUnit(size_t i, fp_t width, fp_t height)
+{
+  bool collision = false;
+
+  if (arrivesAt[i] > now) {
+
+    Vec2 &p = pos[i];
+    const Vec2 &target = targetPos[i];
+    fp_t r = radius[i];
+
+    DPRINT("world: moving unit " << units[i].unitId);
+
+    fp_t dx = delta[i].x;
+    fp_t dy = delta[i].y;
+
+    if (arrivesAt[i] == now+1) {
+      // last step
+      dx = target.x - p.x;
+      dy = target.y - p.y;
+
+      DPRINT("world: unit " << units[i].unitId << " about to stop");
+    }
+
+    fp_t t = 1;
+    fp_t newX = p.x + dx;
+    fp_t newY = p.y + dy;
+
+    // compute collision time t <= 1
+
+    if (dx < 0 && newX - r < 0) {
+      t = std::min(t, 1.0f-(newX - r) / dx);
+    }
+    if (dx > 0 && newX + r > width) {
+      t = std::min(t, 1.0f-(newX + r - width) / dx);
+    }
+    if (dy < 0 && newY - r < 0) {
+      t = std::min(t, 1.0f-(newY - r) / dy);
+    }
+    if (dy > 0 && newY + r > height) {
+      t = std::min(t, 1.0f-(newY + r - height) / dy);
+    }
+
+    p.x += dx * t;
+    p.y += dy * t;
+
+    // clip to box
+
+    if (p.x - r < 0     ) { p.x = r; }
+    if (p.x + r > width ) { p.x = width - r; }
+    if (p.y - r < 0     ) { p.y = r; }
+    if (p.y + r > height) { p.y = height - r; }
+
+    if (t < 1) {
+      // border collision
+      stopMotion(static_cast<int>(i));
+      collision = true;
+      DPRINT("world: border collision " << units[i].unitId);
+    }
+  }
+
+  return collision;
+}
+
+void UnitStore::moveScalar(size_t from, fp_t width, fp_t height,
+                           vector<pair<int, Vec2>> &moved,
+                           vector<int> &collided)
+{
+  for (size_t i=from; i < pos.size(); ++i) {
+
+    Vec2 old = pos[i];
+
+    if (moveUnit(i, width, height)) {
+      collided.push_back(static_cast<int>(i));
+    }
+
+    if (pos[i].x != old.x || pos[i].y != old.y) {
+      moved.push_back({ static_cast<int>(i), old });
+    }
+  }
+}
+
+#if UNIT_STORE_X86
+
+static_assert(sizeof(Vec2) == 2*sizeof(fp_t), "Vec2 must be packed");
+
+// report units k < units of a vector step starting at slot i
+// changed, collided: lane masks (2 lanes per unit)
+static void reportMotion(UnitStore &s, size_t i, int units, const fp_t *old,
+                         int changed, int collision,
+                         vector<pair<int, Vec2>> &moved,
+                         vector<int> &collided)
+{
+  for (int k=0; k < units; ++k) {
+
+    size_t j = i + static_cast<size_t>(k);
+
+    if (collision & (1 << (2*k))) {
+      s.stopMotion(static_cast<int>(j));
+      collided.push_back(static_cast<int>(j));
+    }
+
+    if (changed & (3 << (2*k))) {
+      moved.push_back({ static_cast<int>(j), Vec2(old[2*k], old[2*k+1]) });
+    }
+  }
+}
+
+static inline __m128 blend4(__m128 a, __m128 b, __m128 mask)
+{
+  return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+}
+
+// SSE2: 2 units per step, slots [0, n), n even
+static void moveSSE2(UnitStore &s, size_t n, fp_t width, fp_t height,
+                     vector<pair<int, Vec2>> &moved,
+                     vector<int> &collided)
+{
+  const __m128 one = _mm_set1_ps(1), zero = _mm_setzero_ps();
+  const __m128 lim = _mm_setr_ps(width, height, width, height);
+  const __m128i now = _mm_set1_epi32(s.getFrame());
+
+  fp_t *pos = &s.pos[0].x;
+  const fp_t *delta = &s.delta[0].x;
+  const fp_t *target = &s.targetPos[0].x;
+
+  for (size_t i=0; i < n; i += 2) {
+
+    // remaining frames of motion
+    __m128i mc = _mm_sub_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s.arrivesAt.data() + i)),
+                               now);
+    __m128i moving = _mm_cmpgt_epi32(mc, _mm_setzero_si128());
+
+    if (!_mm_movemask_epi8(moving)) {
+      continue;
+    }
+
+    // unit masks => (x, y) lane pairs
+    __m128 movingXY = _mm_castsi128_ps(_mm_unpacklo_epi32(moving, moving));
+    __m128i last = _mm_cmpeq_epi32(mc, _mm_set1_epi32(1));
+    __m128 lastXY = _mm_castsi128_ps(_mm_unpacklo_epi32(last, last));
+
+    __m128 p = _mm_loadu_ps(pos + 2*i);
+    __m128 d = blend4(_mm_loadu_ps(delta + 2*i), _mm_sub_ps(_mm_loadu_ps(target + 2*i), p), lastXY);
+    __m128 r = _mm_setr_ps(s.radius[i], s.radius[i], s.radius[i+1], s.radius[i+1]);
+
+    __m128 nw = _mm_add_ps(p, d);
+    __m128 lo = _mm_sub_ps(nw, r);
+    __m128 hi = _mm_add_ps(nw, r);
+
+    // collision time per coordinate, then minimum of x and y
+    __m128 tLo = blend4(one, _mm_sub_ps(one, _mm_div_ps(lo, d)),
+                        _mm_and_ps(_mm_cmplt_ps(d, zero), _mm_cmplt_ps(lo, zero)));
+    __m128 tHi = blend4(one, _mm_sub_ps(one, _mm_div_ps(_mm_sub_ps(hi, lim), d)),
+                        _mm_and_ps(_mm_cmpgt_ps(d, zero), _mm_cmpgt_ps(hi, lim)));
+    __m128 t = _mm_min_ps(tLo, tHi);
+    t = _mm_min_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    __m128 np = _mm_add_ps(p, _mm_mul_ps(d, t));
+
+    // clip to box
+    np = blend4(np, r, _mm_cmplt_ps(_mm_sub_ps(np, r), zero));
+    np = blend4(np, _mm_sub_ps(lim, r), _mm_cmpgt_ps(_mm_add_ps(np, r), lim));
+    np = blend4(p, np, movingXY);
+
+    _mm_storeu_ps(pos + 2*i, np);
+
+    alignas(16) fp_t old[4];
+    _mm_store_ps(old, p);
+
+    reportMotion(s, i, 2, old,
+                 _mm_movemask_ps(_mm_cmpneq_ps(np, p)),
+                 _mm_movemask_ps(_mm_and_ps(movingXY, _mm_cmplt_ps(t, one))),
+                 moved, collided);
+  }
+}
+
+#define AVX2_FN __attribute__((target("avx2")))
+
+// AVX2: 4 units per step, slots [0, n), n multiple of 4
+AVX2_FN static void moveAVX2(UnitStore &s, size_t n, fp_t width, fp_t height,
+                             vector<pair<int, Vec2>> &moved,
+                             vector<int> &collided)
+{
+  const __m256 one = _mm256_set1_ps(1), zero = _mm256_setzero_ps();
+  const __m256 lim = _mm256_setr_ps(width, height, width, height, width, height, width, height);
+  const __m256i pairs = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+  const __m128i now = _mm_set1_epi32(s.getFrame());
+
+  fp_t *pos = &s.pos[0].x;
+  const fp_t *delta = &s.delta[0].x;
+  const fp_t *target = &s.targetPos[0].x;
+
+  for (size_t i=0; i < n; i += 4) {
+
+    // remaining frames of motion
+    __m128i mc = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s.arrivesAt.data() + i)),
+                               now);
+    __m128i moving = _mm_cmpgt_epi32(mc, _mm_setzero_si128());
+
+    if (_mm_testz_si128(moving, moving)) {
+      continue;
+    }
+
+    // unit masks => (x, y) lane pairs (sign extension)
+    __m256 movingXY = _mm256_castsi256_ps(_mm256_cvtepi32_epi64(moving));
+    __m128i last = _mm_cmpeq_epi32(mc, _mm_set1_epi32(1));
+    __m256 lastXY = _mm256_castsi256_ps(_mm256_cvtepi32_epi64(last));
+
+    __m256 p = _mm256_loadu_ps(pos + 2*i);
+    __m256 d = _mm256_blendv_ps(_mm256_loadu_ps(delta + 2*i),
+                                _mm256_sub_ps(_mm256_loadu_ps(target + 2*i), p), lastXY);
+    __m256 r = _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_loadu_ps(s.radius.data() + i)),
+                                        pairs);
+
+    __m256 nw = _mm256_add_ps(p, d);
+    __m256 lo = _mm256_sub_ps(nw, r);
+    __m256 hi = _mm256_add_ps(nw, r);
+
+    // collision time per coordinate, then minimum of x and y
+    __m256 tLo = _mm256_blendv_ps(one, _mm256_sub_ps(one, _mm256_div_ps(lo, d)),
+                                  _mm256_and_ps(_mm256_cmp_ps(d, zero, _CMP_LT_OQ),
+                                                _mm256_cmp_ps(lo, zero, _CMP_LT_OQ)));
+    __m256 tHi = _mm256_blendv_ps(one, _mm256_sub_ps(one, _mm256_div_ps(_mm256_sub_ps(hi, lim), d)),
+                                  _mm256_and_ps(_mm256_cmp_ps(d, zero, _CMP_GT_OQ),
+                                                _mm256_cmp_ps(hi, lim, _CMP_GT_OQ)));
+    __m256 t = _mm256_min_ps(tLo, tHi);
+    t = _mm256_min_ps(t, _mm256_permute_ps(t, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    __m256 np = _mm256_add_ps(p, _mm256_mul_ps(d, t));
+
+    // clip to box
+    np = _mm256_blendv_ps(np, r, _mm256_cmp_ps(_mm256_sub_ps(np, r), zero, _CMP_LT_OQ));
+    np = _mm256_blendv_ps(np, _mm256_sub_ps(lim, r),
+                          _mm256_cmp_ps(_mm256_add_ps(np, r), lim, _CMP_GT_OQ));
+    np = _mm256_blendv_ps(p, np, movingXY);
+
+    _mm256_storeu_ps(pos + 2*i, np);
+
+    alignas(32) fp_t old[8];
+    _mm256_store_ps(old, p);
+
+    reportMotion(s, i, 4, old,
+                 _mm256_movemask_ps(_mm256_cmp_ps(np, p, _CMP_NEQ_UQ)),
+                 _mm256_movemask_ps(_mm256_and_ps(movingXY, _mm256_cmp_ps(t, one, _CMP_LT_OQ))),
+                 moved, collided);
+  }
+}
+
+#endif
+
+void UnitStore::move(fp_t width, fp_t height,
+                     vector<pair<int, Vec2>> &moved,
+                     vector<int> &collided)
+{
+  moved.clear();
+  collided.clear();
+
+  size_t done = 0;
+
+#if UNIT_STORE_X86
+  size_t n = pos.size();
+
+  if (RangeKernels::getLevel() >= RangeKernels::AVX2) {
+    done = n & ~size_t(3);
+    moveAVX2(*this, done, width, height, moved, collided);
+  } else if (RangeKernels::getLevel() >= RangeKernels::SSE2) {
+    done = n & ~size_t(1);
+    moveSSE2(*this, done, width, height, moved, collided);
+  }
+#endif
+
+  moveScalar(done, width, height, moved, collided);
+
+  for (auto &m : moved) {
+    rehash(static_cast<size_t>(m.first));
+  }
+
+  ++now;
+}
+
+uint64_t UnitStore::unitHash(size_t i) const
+{
+  // bit patterns, so hashes differ iff states differ
+  auto bits = [](const Vec2 &v) {
+    uint32_t x, y;
+    memcpy(&x, &v.x, sizeof(x));
+    memcpy(&y, &v.y, sizeof(y));
+    return static_cast<uint64_t>(x) << 32 | y;
+  };
+  auto pair = [](int a, int b) {
+    return static_cast<uint64_t>(static_cast<uint32_t>(a)) << 32 | static_cast<uint32_t>(b);
+  };
+
+  // delta follows from position and target at motion start
+  uint64_t h = mix64(pair(units[i].unitId, hp[i]));
+  h = mix64(h ^ bits(pos[i]));
+  h = mix64(h ^ bits(targetPos[i]));
+  return mix64(h ^ pair(arrivesAt[i], readyAt[i]));
+}
+
+uint64_t UnitStore::computeStateHash() const
+{
+  uint64_t h = 0;
+  for (size_t i=0; i < units.size(); ++i) {
+    h += unitHash(i);
+  }
+  return h;
+}
+
+void UnitStore::expireTimers(array<vector<int>, 2> &ready,
+                             array<vector<int>, 2> &idle)
+{
+  for (int i=0; i < 2; ++i) {
+    ready[static_cast<size_t>(i)].clear();
+    idle[static_cast<size_t>(i)].clear();
+  }
+
+  expired.clear();
+  timers.advance(now, expired);
+
+  for (const UnitTimer &t : expired) {
+
+    int slot = slotOf(t.unitId);
+
+    if (slot < 0) {
+      continue; // dead
+    }
+
+    size_t i = static_cast<size_t>(slot);
+    size_t owner = static_cast<size_t>(units[i].owner);
+
+    // skip stale timers and units already reported
+    
+    if (t.type == READY) {
+      if (readyAt[i] <= now && !readyFlags.test(i)) {
+        readyFlags.set(i);
+        ready[owner].push_back(slot);
+      }
+    } else {
+      if (arrivesAt[i] <= now && !idleFlags.test(i)) {
+        idleFlags.set(i);
+        idle[owner].push_back(slot);
+      }
+    }
+  }
+
+  for (int i=0; i < 2; ++i) {
+    sort(ready[static_cast<size_t>(i)].begin(), ready[static_cast<size_t>(i)].end());
+    sort(idle[static_cast<size_t>(i)].begin(), idle[static_cast<size_t>(i)].end());
+  }
+}
+
+void UnitStore::pendingUnits(int owner, vector<const Unit*> &result) const
+{
+  result.clear();
+
+  size_t first = owner == 0 ? 0 : static_cast<size_t>(ownerCounts[0]);
+  size_t last = owner == 0 ? static_cast<size_t>(ownerCounts[0]) : units.size();
+
+  // scan words of both flag sets, masked to the partition
+
+  for (size_t k = first / 64; k * 64 < last; ++k) {
+
+    uint64_t w = readyFlags.word(k) | idleFlags.word(k);
+
+    if (k * 64 < first) {
+      w &= ~uint64_t(0) << (first % 64);
+    }
+    if ((k+1) * 64 > last) {
+      w &= ~(~uint64_t(0) << (last % 64));
+    }
+
+    while (w) {
+      size_t i = k * 64 + static_cast<size_t>(__builtin_ctzll(w));
+      result.push_back(&units[i]);
+      w &= w - 1;
+    }
+  }
+}
+
+void UnitStore::writeState(Serial::StateHeader &h, char *out) const
+{
+  h.storeFrame = now;
+  h.timerFrame = timers.getFrame();
+  h.maxRadius[0] = maxRadius[0];
+  h.maxRadius[1] = maxRadius[1];
+  h.maxVisionRange[0] = maxVisionRange[0];
+  h.maxVisionRange[1] = maxVisionRange[1];
+  h.unitCount = size();
+  h.ownerCount0 = ownerCounts[0];
+
+  for (size_t i=0; i < units.size(); ++i) {
+
+    const Unit &u = units[i];
+    Serial::UnitRecord r;
+
+    r.unitId = u.unitId;
+    r.type = u.type;
+    r.owner = u.owner;
+    r.hp = hp[i];
+    r.arrivesAt = arrivesAt[i];
+    r.readyAt = readyAt[i];
+    r.maxHp = u.maxHp;
+    r.attack = u.attack;
+    r.cooldown = u.cooldown;
+    r.x = pos[i].x;
+    r.y = pos[i].y;
+    r.dx = delta[i].x;
+    r.dy = delta[i].y;
+    r.tx = targetPos[i].x;
+    r.ty = targetPos[i].y;
+    r.radius = u.radius;
+    r.maxSpeed = u.maxSpeed;
+    r.visionRange = u.visionRange;
+    r.attackRange = u.attackRange;
+    r.onlyAttackWhenStopped = u.onlyAttackWhenStopped;
+    r.readyReported = readyFlags.test(i);
+    r.idleReported = idleFlags.test(i);
+    r.pad = 0;
+
+    memcpy(out, &r, sizeof(r));
+    out += sizeof(r);
+  }
+}
+
+void UnitStore::readState(const Serial::StateHeader &h, const char *in)
+{
+  if (h.unitCount < 0 || h.ownerCount0 < 0 || h.ownerCount0 > h.unitCount) {
+    ERR("UnitStore: bad unit counts in state");
+  }
+
+  size_t n = static_cast<size_t>(h.unitCount);
+
+  units.resize(n);
+  pos.resize(n);
+  delta.resize(n);
+  targetPos.resize(n);
+  arrivesAt.resize(n);
+  hp.resize(n);
+  readyAt.resize(n);
+  radius.resize(n);
+  hashes.resize(n);
+  readyFlags.resize(n);
+  idleFlags.resize(n);
+  id2slot.clear();
+
+  now = h.storeFrame;
+  timers.clear(h.timerFrame);
+  ownerCounts = { h.ownerCount0, h.unitCount - h.ownerCount0 };
+  maxRadius = { h.maxRadius[0], h.maxRadius[1] };
+  maxVisionRange = { h.maxVisionRange[0], h.maxVisionRange[1] };
+
+  int next = timers.getFrame()+1;
+
+  for (size_t i=0; i < n; ++i) {
+
+    Serial::UnitRecord r;
+    memcpy(&r, in, sizeof(r));
+    in += sizeof(r);
+
+    if (r.unitId < 0 || r.owner != (static_cast<int>(i) < h.ownerCount0 ? 0 : 1)) {
+      ERR("UnitStore: bad unit record " << i << " in state");
+    }
+
+    Unit &u = units[i];
+    u = Unit(r.owner);
+    u.unitId = r.unitId;
+    u.type = r.type;
+    u.maxHp = r.maxHp;
+    u.attack = r.attack;
+    u.cooldown = r.cooldown;
+    u.radius = r.radius;
+    u.maxSpeed = r.maxSpeed;
+    u.visionRange = r.visionRange;
+    u.attackRange = r.attackRange;
+    u.onlyAttackWhenStopped = r.onlyAttackWhenStopped != 0;
+
+    pos[i]       = Vec2(r.x, r.y);
+    delta[i]     = Vec2(r.dx, r.dy);
+    targetPos[i] = Vec2(r.tx, r.ty);
+    arrivesAt[i] = r.arrivesAt;
+    hp[i]        = r.hp;
+    readyAt[i]   = r.readyAt;
+    radius[i]    = r.radius;
+
+    size_t id = static_cast<size_t>(r.unitId);
+
+    if (id >= id2slot.size()) {
+      id2slot.resize(id+1, -1);
+    }
+    if (id2slot[id] >= 0) {
+      ERR("UnitStore: duplicate unit id " << r.unitId << " in state");
+    }
+    id2slot[id] = static_cast<int>(i);
+
+    // units not reported yet: pending timers fire at the same frames
+    if (r.readyReported) {
+      readyFlags.set(i);
+    } else {
+      timers.schedule(max(readyAt[i], next), { r.unitId, READY });
+    }
+
+    if (r.idleReported) {
+      idleFlags.set(i);
+    } else {
+      timers.schedule(max(arrivesAt[i], next), { r.unitId, ARRIVAL });
+    }
+  }
+
+  stateHash = 0;
+  for (size_t i=0; i < n; ++i) {
+    hashes[i] = unitHash(i);
+    stateHash += hashes[i];
+  }
+
+  publish();
+}
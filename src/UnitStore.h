@@ -0,0 +1,231 @@
+#pragma once
+
+// dense unit storage owned by World
+//
+// units live in contiguous slots [0, size()); dead units are removed by
+// swap-and-pop, so slots are not stable - use unit ids to refer to units
+// across frames and slotOf(id) to find them (O(1) table lookup)
+//
+// slots are partitioned by owner: player 0 units occupy [0, n0), player 1
+// units [n0, size()), so each player's units can be handed out as a span
+//
+// hot dynamic state (pos, delta, targetPos, arrivesAt, hp, readyAt) is kept
+// in separate columns which world phases read and write; the Unit records
+// hold the fixed unit properties plus a copy of the dynamic state that is
+// refreshed by publish() once per frame (what players and listeners see);
+// radius is fixed, but also has a column for the motion kernel
+//
+// motion and cooldown are stored as absolute frames (arrivesAt, readyAt)
+// instead of counters, so nothing is decremented per frame; publish()
+// converts them back to the records' moveCount / cooldownCount; a timer
+// wheel reports units which become ready to attack or idle (stopped), and
+// per slot flags remember which units currently are
+//
+// the store also maintains a hash of all units' dynamic state: the sum of
+// per unit hashes, each refreshed when its unit changes (moves, starts or
+// stops, attacks, gets hit) - cost is proportional to the units that
+// change, not to all units
+
+#include "Global.h"
+#include "Unit.h"
+#include "TimerWheel.h"
+#include "Serial.h"
+#include <vector>
+#include <array>
+
+class UnitStore
+{
+public:
+
+  UnitStore()
+  {
+    clear();
+  }
+
+  void clear();
+
+  int size() const { return static_cast<int>(units.size()); }
+
+  // slot of unit with id unitId, -1 if not present
+  int slotOf(int unitId) const
+  {
+    if (unitId < 0 || unitId >= static_cast<int>(id2slot.size())) {
+      return -1;
+    }
+    return id2slot[static_cast<size_t>(unitId)];
+  }
+
+  // number of units owned by player 0 / 1
+  std::pair<int, int> countUnits() const { return { ownerCounts[0], ownerCounts[1] }; }
+
+  // published unit records (dynamic state as of last publish())
+  const std::vector<Unit> &getUnits() const { return units; }
+  const Unit &record(int slot) const { return units[static_cast<size_t>(slot)]; }
+
+  // published records of units owned by player
+  Span<Unit> getUnits(int owner) const
+  {
+    const Unit *first = units.data();
+    const Unit *mid = first + ownerCounts[0];
+    return owner == 0 ? Span<Unit>(first, mid) : Span<Unit>(mid, first + units.size());
+  }
+
+  // maximum radius of units ever added for player (bound for range queries)
+  fp_t getMaxRadius(int owner) const { return maxRadius[static_cast<size_t>(owner)]; }
+
+  // same for vision range
+  fp_t getMaxVisionRange(int owner) const { return maxVisionRange[static_cast<size_t>(owner)]; }
+
+  // add unit at the end of its owner's partition;
+  // its dynamic state is taken from u
+  void add(const Unit &u);
+
+  // slot changes caused by remove(): unit in slot from[i] now is in to[i]
+  struct Relocations
+  {
+    int n = 0;
+    std::array<int, 2> from, to;
+  };
+
+  // remove unit in slot by moving the last unit of the partition into it
+  Relocations remove(int slot);
+
+  // copy hot columns into unit records
+  void publish();
+
+  // same for a single unit
+  void publish(int slot)
+  {
+    size_t i = static_cast<size_t>(slot);
+    Unit &u = units[i];
+    u.pos = pos[i];
+    u.delta = delta[i];
+    u.targetPos = targetPos[i];
+    u.moveCount = std::max(arrivesAt[i] - now, 0);
+    u.hp = hp[i];
+    u.cooldownCount = std::max(readyAt[i] - now, 0);
+  }
+
+  // current frame (advanced by move())
+  int getFrame() const { return now; }
+
+  // hash of dynamic unit state (ids, positions, targets, hp, motion and
+  // cooldown frames); independent of slot order
+  uint64_t getStateHash() const { return stateHash; }
+
+  // same, computed from scratch
+  uint64_t computeStateHash() const;
+
+  // store part of a serialized state: frames, bounds, and unit counts
+  // => h, records of all units in slot order => out (sizeof(UnitRecord)
+  // bytes each)
+  void writeState(Serial::StateHeader &h, char *out) const;
+
+  // replace all units by h.unitCount records (as written by writeState);
+  // timers are rescheduled, so units become ready / idle as they would have
+  void readState(const Serial::StateHeader &h, const char *in);
+
+  // dynamic state transitions (see Unit.h for the record versions)
+
+  void startMotion(int slot, const Vec2 &whereTo);
+
+  void stopMotion(int slot)
+  {
+    size_t i = static_cast<size_t>(slot);
+
+    if (arrivesAt[i] > now) {
+      arrivesAt[i] = now;
+      timers.schedule(now+1, { units[i].unitId, ARRIVAL });
+      rehash(i);
+    }
+  }
+
+  bool isMoving(int slot) const { return arrivesAt[static_cast<size_t>(slot)] > now; }
+
+  bool readyForAttack(int slot) const { return readyAt[static_cast<size_t>(slot)] <= now; }
+
+  // @return true if unit in toSlot is dead
+  bool executeAttack(int fromSlot, int toSlot, int cooldownDelta);
+
+  // motion step of all units in one pass (SIMD if available), then the
+  // frame advances: moving units advance by delta - on their last step
+  // exactly to targetPos - and stop when hitting the border of
+  // [0,width] x [0,height], positions are clipped to the box
+  // moved: slots and old positions of units whose position changed
+  // collided: slots of units stopped by border collisions
+  // (both in increasing slot order)
+  void move(fp_t width, fp_t height,
+            std::vector<std::pair<int, Vec2>> &moved,
+            std::vector<int> &collided);
+
+  // expire timers up to the current frame: units that became ready to
+  // attack / idle since the last call => ready[owner] / idle[owner]
+  // (slots, increasing)
+  void expireTimers(std::array<std::vector<int>, 2> &ready,
+                    std::array<std::vector<int>, 2> &idle);
+
+  // units of owner that are ready to attack or idle (as of the last
+  // expireTimers() call and the transitions since) => result, in slot order
+  void pendingUnits(int owner, std::vector<const Unit*> &result) const;
+
+  // hot columns, indexed by slot
+  std::vector<Vec2> pos;
+  std::vector<Vec2> delta;      // position change per frame
+  std::vector<Vec2> targetPos;
+  std::vector<int>  arrivesAt;  // <= frame <=> stopped
+  std::vector<int>  hp;
+  std::vector<int>  readyAt;    // <= frame <=> can attack
+  std::vector<fp_t> radius;     // fixed
+
+private:
+
+  std::vector<Unit> units;   // records, indexed by slot
+  std::vector<int> id2slot;  // unit id -> slot (-1: not present)
+  std::array<int, 2> ownerCounts;
+  std::array<fp_t, 2> maxRadius;
+  std::array<fp_t, 2> maxVisionRange;
+  int now; // frame
+
+  // timers fire when readyAt / arrivesAt are reached; stale ones (e.g. of
+  // units that were given a new target or died) are skipped
+  enum TimerType { READY=0, ARRIVAL };
+
+  struct UnitTimer
+  {
+    int unitId;
+    TimerType type;
+  };
+
+  TimerWheel<UnitTimer> timers;
+  std::vector<UnitTimer> expired; // scratch
+  Bitset readyFlags, idleFlags;   // by slot: reported by expireTimers()
+
+  std::vector<uint64_t> hashes;   // by slot: unitHash() as of last change
+  uint64_t stateHash;             // sum of hashes
+
+  uint64_t unitHash(size_t i) const;
+
+  // unit in slot i changed
+  void rehash(size_t i)
+  {
+    uint64_t h = unitHash(i);
+    stateHash += h - hashes[i];
+    hashes[i] = h;
+  }
+
+  void pushSlot();
+
+  void popSlot();
+
+  // copy unit in slot from to slot to
+  void copySlot(size_t to, size_t from, Relocations &rel);
+
+  // motion step of unit in slot i
+  // @return true if unit stopped at border
+  bool moveUnit(size_t i, fp_t width, fp_t height);
+
+  // move() for slots [from, size()) in scalar code
+  void moveScalar(size_t from, fp_t width, fp_t height,
+                  std::vector<std::pair<int, Vec2>> &moved,
+                  std::vector<int> &collided);
+};
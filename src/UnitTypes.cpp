@@ -3,42 +3,46 @@
 // data from https://liquipedia.net/starcraft/List_of_Unit_and_Building_Sizes
 // etc.
 
-Unit makeMarine(int owner_, const Vec2 &pos)
-{
-  Unit u(owner_, pos);
+static const UnitType unitTypes[UNIT_TYPE_COUNT] = {
 
-  u.type = MARINE;
+  // radius  speed  vision  attack range  hp   attack  cooldown  only when stopped
+  {  9,      4,     7*32,   4*32,         40,  6,      15,       true },  // MARINE
+  { 16,      4,     10*32,  7*32,         150, 30,     37,       true }   // TANK
+};
 
-  u.radius = 9;
-  u.maxSpeed = 4;
-  u.visionRange = 7*32;
-  u.attackRange = 4*32;
-  u.maxHp = 40;
-  u.attack = 6;
-  u.cooldown = 15;
-  u.onlyAttackWhenStopped = true;
-
-  u.startValues();
-
-  return u;
+const UnitType &unitType(UnitTypes t)
+{
+  assert(t >= 0 && t < UNIT_TYPE_COUNT);
+  return unitTypes[t];
 }
 
-Unit makeTank(int owner_, const Vec2 &pos)
+Unit makeUnit(UnitTypes t, int owner_, const Vec2 &pos)
 {
+  const UnitType &ut = unitType(t);
   Unit u(owner_, pos);
 
-  u.type = TANK;
+  u.type = t;
 
-  u.radius = 16;
-  u.maxSpeed = 4;
-  u.visionRange = 10*32;
-  u.attackRange = 7*32;
-  u.maxHp = 150;
-  u.attack = 30;
-  u.cooldown = 37;
-  u.onlyAttackWhenStopped = true;
+  u.radius = ut.radius;
+  u.maxSpeed = ut.maxSpeed;
+  u.visionRange = ut.visionRange;
+  u.attackRange = ut.attackRange;
+  u.maxHp = ut.maxHp;
+  u.attack = ut.attack;
+  u.cooldown = ut.cooldown;
+  u.onlyAttackWhenStopped = ut.onlyAttackWhenStopped;
 
   u.startValues();
 
   return u;
 }
+
+Unit makeMarine(int owner_, const Vec2 &pos)
+{
+  return makeUnit(MARINE, owner_, pos);
+}
+
+Unit makeTank(int owner_, const Vec2 &pos)
+{
+  return makeUnit(TANK, owner_, pos);
+}
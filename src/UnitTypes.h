@@ -1,6 +1,27 @@
+#pragma once
+
 #include "Unit.h"
 
-enum UnitTypes { MARINE = 0, TANK };
+enum UnitTypes { MARINE = 0, TANK, UNIT_TYPE_COUNT };
+
+// fixed properties of a unit type (see Unit)
+struct UnitType
+{
+  fp_t radius;
+  fp_t maxSpeed;
+  fp_t visionRange;
+  fp_t attackRange;
+  int  maxHp;
+  int  attack;
+  int  cooldown;
+  bool onlyAttackWhenStopped;
+};
+
+// properties of type t, without creating a unit
+const UnitType &unitType(UnitTypes t);
+
+// unit of type t with start values (unit id is assigned by World::addUnit)
+Unit makeUnit(UnitTypes t, int owner_, const Vec2 &pos = Vec2());
 
 Unit makeMarine(int owner_, const Vec2 &pos = Vec2());
 
@@ -0,0 +1,158 @@
+#include "VecWorld.h"
+#include "P_Extern.h"
+#include <algorithm>
+
+using namespace std;
+
+VecWorld::VecWorld(const GameSpec &spec_, int n_, int threads)
+  : spec(spec_), n(n_), envs(static_cast<size_t>(max(n_, 0)))
+{
+  if (n < 1) {
+    ERR("VecWorld: need at least one world");
+  }
+
+  pool.reset(new ThreadPool(threads));
+
+  // units are only added at setup => a game of spec tells buffer sizes
+  maxUnits = static_cast<int>(Game(spec).getWorld().getUnits().size());
+
+  size_t rows = static_cast<size_t>(n) * static_cast<size_t>(maxUnits);
+  observations.assign(rows * FEATURES, 0);
+  actions.resize(rows);
+  rewards.assign(static_cast<size_t>(n), 0);
+  dones.assign(static_cast<size_t>(n), 0);
+
+  for (Env &e : envs) {
+    e.rowIds.assign(static_cast<size_t>(maxUnits), -1);
+    e.rowOwners.assign(static_cast<size_t>(maxUnits), -1);
+  }
+
+  reset();
+}
+
+
+void VecWorld::reset()
+{
+  pool->run(n, [this](int i) {
+    newGame(i);
+    observe(i);
+  });
+
+  fill(rewards.begin(), rewards.end(), 0.0f);
+  fill(dones.begin(), dones.end(), 0);
+  fill(actions.begin(), actions.end(), UnitAction());
+}
+
+
+void VecWorld::step()
+{
+  pool->run(n, [this](int i) { stepEnv(i); });
+
+  steps += n;
+  for (uint8_t d : dones) {
+    episodes += d;
+  }
+
+  fill(actions.begin(), actions.end(), UnitAction());
+}
+
+
+void VecWorld::newGame(int i)
+{
+  Env &e = envs[static_cast<size_t>(i)];
+
+  GameSpec s = spec;
+  s.seed = spec.seed + i + e.games * n;
+  e.game.reset(new Game(s));
+  ++e.games;
+
+  for (int p=0; p < 2; ++p) {
+    e.externs[static_cast<size_t>(p)] = dynamic_cast<P_Extern*>(&e.game->getPlayer(p));
+  }
+}
+
+
+void VecWorld::stepEnv(int i)
+{
+  size_t w = static_cast<size_t>(i);
+  Env &e = envs[w];
+  const UnitAction *acts = actions.data() + w * static_cast<size_t>(maxUnits);
+
+  // route actions to extern players
+
+  for (size_t r=0; r < static_cast<size_t>(maxUnits); ++r) {
+
+    const UnitAction &ua = acts[r];
+
+    if (ua.type == Action::NOP || e.rowIds[r] < 0) {
+      continue;
+    }
+
+    P_Extern *p = e.externs[static_cast<size_t>(e.rowOwners[r])];
+
+    if (!p) {
+      continue; // not controlled from outside
+    }
+
+    Action a;
+    a.type = static_cast<Action::Type>(ua.type);
+    a.attackTargetId = ua.targetId;
+    a.movePos = Vec2(ua.x, ua.y);
+    p->addAction(e.rowIds[r], a);
+  }
+
+  // advance; game over is reported in the frame that ended it
+
+  Game &g = *e.game;
+  World &world = g.getWorld();
+  bool running = g.step() && !world.gameFinished() && world.getFrameCount() < g.getMaxSteps();
+
+  if (running) {
+    rewards[w] = 0;
+    dones[w] = 0;
+  } else {
+    rewards[w] = static_cast<float>(g.result().score0);
+    dones[w] = 1;
+    newGame(i);
+  }
+
+  observe(i);
+}
+
+
+void VecWorld::observe(int i)
+{
+  size_t w = static_cast<size_t>(i);
+  Env &e = envs[w];
+  const vector<Unit> &units = e.game->getWorld().getUnits();
+
+  if (units.size() > static_cast<size_t>(maxUnits)) {
+    ERR("VecWorld: world " << i << " has more than " << maxUnits << " units");
+  }
+
+  float *row = observations.data() + w * static_cast<size_t>(maxUnits) * FEATURES;
+  size_t r = 0;
+
+  for (const Unit &u : units) {
+    row[ALIVE]    = 1;
+    row[ID]       = static_cast<float>(u.unitId);
+    row[OWNER]    = static_cast<float>(u.owner);
+    row[TYPE]     = static_cast<float>(u.type);
+    row[X]        = u.pos.x;
+    row[Y]        = u.pos.y;
+    row[HP]       = static_cast<float>(u.hp);
+    row[COOLDOWN] = static_cast<float>(max(u.cooldownCount, 0));
+    row[MOVING]   = static_cast<float>(u.moveCount);
+    e.rowIds[r] = u.unitId;
+    e.rowOwners[r] = u.owner;
+    row += FEATURES;
+    ++r;
+  }
+
+  fill(row, observations.data() + (w+1) * static_cast<size_t>(maxUnits) * FEATURES, 0.0f);
+
+  for (; r < static_cast<size_t>(maxUnits); ++r) {
+    e.rowIds[r] = -1;
+    e.rowOwners[r] = -1;
+  }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+// n independent games stepped in lockstep (e.g. for ML training)
+//
+// step() hands each world the actions of its extern players (player type
+// "Extern", see P_Extern), advances all worlds by one frame on a thread
+// pool, and writes observations, rewards, and done flags into contiguous
+// buffers owned by VecWorld (pointers stay valid, so they can be wrapped
+// without copying)
+//
+// a finished game is replaced by a new one with the next seed of that
+// world; its done flag and reward refer to the finished game, while its
+// observation already shows the new one
+//
+// observations: getMaxUnits() rows of FEATURES floats per world; rows
+// follow the world's unit slots (RED units first), unused rows are zero
+//
+// actions: one UnitAction per observation row, applied to the unit shown
+// in that row of the last observation if it belongs to an extern player
+// (NOP: no new order)
+
+#include "Global.h"
+#include "Action.h"
+#include "Game.h"
+#include "ThreadPool.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class P_Extern;
+
+class VecWorld
+{
+public:
+
+  // observation row layout
+  enum Feature { ALIVE = 0, ID, OWNER, TYPE, X, Y, HP, COOLDOWN, MOVING, FEATURES };
+
+  struct UnitAction
+  {
+    int32_t type = Action::NOP;  // Action::Type
+    int32_t targetId = -1;       // ATTACK: unit id
+    float x = 0, y = 0;          // MOVE: destination
+  };
+
+  // n worlds playing spec; world i's k-th game uses seed spec.seed + i + k*n
+  // threads: including the calling thread
+  VecWorld(const GameSpec &spec, int n, int threads);
+
+  int getSize() const { return n; }
+  int getMaxUnits() const { return maxUnits; }
+
+  float *getObservations() { return observations.data(); }
+  UnitAction *getActions() { return actions.data(); }
+  float *getRewards() { return rewards.data(); }    // RED's score when done, else 0
+  uint8_t *getDones() { return dones.data(); }
+
+  // start new games in all worlds, write observations, clear actions
+  void reset();
+
+  // execute actions, advance all worlds by one frame, write outputs,
+  // clear actions
+  void step();
+
+  // frames executed and games finished by all worlds
+  int64_t getSteps() const { return steps; }
+  int64_t getEpisodes() const { return episodes; }
+
+private:
+
+  struct Env
+  {
+    std::unique_ptr<Game> game;
+    std::array<P_Extern *, 2> externs{{ nullptr, nullptr }}; // nullptr: not extern
+    int games = 0;               // started so far
+    std::vector<int> rowIds;     // unit id shown in each row, -1: none
+    std::vector<int> rowOwners;
+  };
+
+  GameSpec spec;
+  int n;
+  int maxUnits = 0;
+  std::vector<Env> envs;
+  std::unique_ptr<ThreadPool> pool;
+
+  std::vector<float> observations;
+  std::vector<UnitAction> actions;
+  std::vector<float> rewards;
+  std::vector<uint8_t> dones;
+
+  int64_t steps = 0, episodes = 0;
+
+  void newGame(int i);
+  void stepEnv(int i);
+  void observe(int i);
+};
@@ -6,10 +6,10 @@ using namespace std;
 
 void W_Plain::setup(fp_t width, fp_t height, bool fogOfWar, int seed,
                     Player *p0, Player *p1,
-                    fp_t qtEps,
+                    const SpatialParams &spatial,
                     const std::string &params)
 {
-  World::setup(width, height, fogOfWar, seed, p0, p1, qtEps, params);
+  World::setup(width, height, fogOfWar, seed, p0, p1, spatial, params);
 
   istringstream is(params);
 
@@ -23,13 +23,8 @@ void W_Plain::setup(fp_t width, fp_t height, bool fogOfWar, int seed,
 
   // populate with units
 
-  // get unit sizes - a bit awkward
-
-  Unit m = makeMarine(RED);
-  fp_t mr = m.radius;
-
-  m = makeTank(RED);
-  fp_t tr = m.radius;
+  fp_t mr = unitType(MARINE).radius;
+  fp_t tr = unitType(TANK).radius;
 
   // create marines
   
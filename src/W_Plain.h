@@ -10,7 +10,7 @@ public:
 
   void setup(fp_t width, fp_t height, bool fogOfWar, int seed,
              Player *p0, Player *p1,
-             fp_t qtEps,
+             const SpatialParams &spatial,
              const std::string &params) override;
 
   bool gameFinished() const override;
@@ -6,21 +6,20 @@
 
 using namespace std;
 
-// todo: use quadtrees
-
-void World::setup(fp_t width_, fp_t height_, bool fogOfWar_, int seed,
+void World::setup(fp_t width_, fp_t height_, bool fogOfWar_, int seed_,
                   Player *p0, Player *p1,
-                  fp_t qtEps_,
+                  const SpatialParams &spatial_,
                   const std::string &params_)
 {
   width = width_;
   height = height_;
   fogOfWar = fogOfWar_;
-  qtEps = qtEps_;
+  spatial = spatial_;
+  tuner.setup(spatial, width, height);
+  setupIndexes();
 
-  // larger to accomodate max coordinates
-  //!!!qts[0].setup(width+1, height+1, qtEps);
-  //!!!qts[1].setup(width+1, height+1, qtEps);  
+  fow.setup(width+1, height+1);
+  kinRanges.setup(width, height);
   
   players.clear();
   players.push_back(p0);
@@ -30,104 +29,13 @@ void World::setup(fp_t width_, fp_t height_, bool fogOfWar_, int seed,
 
   params = params_;
   
-  id2unit.clear();
-
-  rng.seed((unsigned long)seed);
-}
-
-// integer [0,n)
-int World::rndInt(int n, RNG &rng) const
-{
-  assert(n > 0);
-  std::uniform_int_distribution<int> dist(0,n-1); // range [0,n-1]
-  int r = dist(rng);
-  assert(r >= 0 && r < n);
-  return r;
-}
-
-// double [0,1)
-fp_t World::rnd01(RNG &rng) const
-{
-  std::uniform_real_distribution<double> dist(0,1); // range [0,1)
-  double r = dist(rng);
-  assert(r >= 0 && r < 1);
-  return (fp_t)r;
-}
-
-Vec2 World::rndPos(fp_t radius, RNG &rng) const
-{
-  fp_t slack = radius * 1.1f;
-
-  Vec2 p((width  - 2*slack) * rnd01(rng) + slack,
-         (height - 2*slack) * rnd01(rng) + slack);
-  
-  // assert circle in rectangle
-  assert(p.x > radius && p.x < width - radius);
-  assert(p.y > radius && p.y < height - radius);
-  return p;
-}
-
-Vec2 World::rndEdgePos(fp_t radius, const Vec2 &now, RNG &rng) const
-{
-  fp_t slack = radius * 1.05f;
-  fp_t xLow = width  * 0.05f, xHigh = width  * 0.95f;
-  fp_t yLow = height * 0.05f, yHigh = height * 0.95f;
-  Vec2 p;
-
-  if (rnd01() < 0.5f) {
-    
-    // constrain y
-    
-    p.x = (width - 2*slack) * rnd01() + slack;
-
-    if (now.y < yLow) {
-      p.y = height - slack;
-    } else if (now.y > yHigh) {
-      p.y = slack;
-    } else if (rnd01() < 0.5f) {
-      p.y = slack;
-    } else {
-      p.y = height - slack;
-    }
-    
-  } else {
-    
-    // constain x
-
-    p.y = (height - 2*slack) * rnd01(rng) + slack;
-
-    if (now.x < xLow) {
-      p.x = width - slack;
-    } else if (now.x > xHigh) {
-      p.x = slack;
-    } else if (rnd01() < 0.5f) {
-      p.x = slack;
-    } else {
-      p.x = width - slack;
-    }
-  }
-    
-  // assert circle in rectangle
-  assert(p.x > radius && p.x < width - radius);
-  assert(p.y > radius && p.y < height - radius);
-  return p;
-}
-
-pair<int, int> World::countUnits() const
-{
-  pair<int, int> counts{ 0, 0 };
+  store.clear();
+  unitIds.clear();
 
-  for (auto &p : id2unit) {
-    if (p.second.owner == 0) {
-      ++counts.first;
-    } else {
-      ++counts.second;
-    }
-  }
-  return counts;
+  seed = seed_;
+  rng = KeyedRNG(static_cast<uint64_t>(seed), 0, 0, RndPurpose::SETUP);
 }
 
-
 /*
   f  f.vision   t.r t
   x------------|----x
@@ -138,7 +46,7 @@ pair<int, int> World::countUnits() const
             
 */
             
-bool World::canSee(const std::vector<Unit> &units, const Unit &u)
+bool World::canSee(Span<Unit> units, const Unit &u)
 {
   // todo: speed up with sectors
   
@@ -151,9 +59,50 @@ bool World::canSee(const std::vector<Unit> &units, const Unit &u)
 }
 
 
-bool World::isVisible(const Unit &u)
+void World::computeVisibility()
 {
-  return canSee(selfViews[1-u.owner].getUnits(), u);
+  assert(fogOfWar);
+  
+  // one tile lookup per unit
+  
+  for (int i=0; i < store.size(); ++i) {
+
+    const Unit &u = store.record(i);
+    
+    visibleKnown.set(static_cast<size_t>(i));
+    
+    if (fow.isSeen(1-u.owner, u.pos)) {
+      visible.set(static_cast<size_t>(i));
+    }
+  }
+}
+
+
+void World::computeVisibility(int slot)
+{
+  const Unit &u = store.record(slot);
+  int opp = 1-u.owner;
+  bool seen;
+
+  if (spatial.useIndex()) {
+
+    // search opponent index for a unit whose vision circle reaches u
+    // (indexes are up to date until units are removed or moved)
+    
+    fp_t r = store.getMaxVisionRange(opp) + u.radius;
+    seen = indexes[static_cast<size_t>(opp)].any(
+      u.pos.x - r, u.pos.x + r, u.pos.y - r, u.pos.y + r,
+      [&](const Unit *v) { return v->pos.dist2(u.pos) < square(v->visionRange + u.radius); });
+
+  } else {
+    seen = canSee(store.getUnits(opp), u);
+  }
+
+  visibleKnown.set(static_cast<size_t>(slot));
+  
+  if (seen) {
+    visible.set(static_cast<size_t>(slot));
+  }
 }
 
 
@@ -172,6 +121,24 @@ bool World::canAttack(const Unit &from, const Unit &to)
 }
 
 
+void World::setupIndexes()
+{
+  // larger to accomodate max coordinates
+  indexes[0].setup(spatial, width+1, height+1);
+  indexes[1].setup(spatial, width+1, height+1);
+  indexesValid = false;
+}
+
+
+void World::rebuildIndexes()
+{
+  for (int i=0; i < 2; ++i) {
+    indexes[i].build(store.getUnits(i));
+  }
+  indexesValid = true;
+}
+
+
 void World::computeViews()
 {
   assert(players.size() == 2);
@@ -179,48 +146,75 @@ void World::computeViews()
   selfViews.resize(2);
   opponentViews.resize(2);
 
-  for (int i=0; i < 2; ++i) {
-    selfViews[i].setup(i, width, height, fogOfWar, qtEps);
-    opponentViews[i].setup(i, width, height, fogOfWar, qtEps);
-    //!!!qts[i].clear();
-  }  
-  
-  for (const auto &p : id2unit) {
-    int ownerIndex = static_cast<size_t>(p.second.owner);
-    selfViews[ownerIndex].addUnit(p.second);
-    if (Quadtree<Unit>::useQt(qtEps)) {
-      //!!!qts[ownerIndex].insert(&p.second);
+  std::array<const SpatialIndex<Unit>*, 2> index = { nullptr, nullptr };
+
+  if (spatial.useIndex()) {
+    if (!indexesValid) {
+      rebuildIndexes();
     }
+    index[0] = &indexes[0];
+    index[1] = &indexes[1];
   }
 
+  if (kinetic) {
+    kinRanges.update(frameCounter, store, index);
+  }
+
+  // units that became ready to attack or idle
+  store.expireTimers(readySlots, idleSlots);
+
+  // positions don't change until motion is executed, so visibility is
+  // valid for the attack phase as well; without fog of war it's only
+  // needed there, for attacked units
+  visible.resize(static_cast<size_t>(store.size()));
+  visibleKnown.resize(static_cast<size_t>(store.size()));
+  
   if (fogOfWar) {
+    computeVisibility();
+  }
+  
+  // views point into unit storage - no copies
+
+  for (int i=0; i < 2; ++i) {
+    selfViews[i].setup(i, width, height, fogOfWar);
+    opponentViews[i].setup(i, width, height, fogOfWar);
+    selfViews[i].setUnits(store.getUnits(i), store.getMaxRadius(i), index[static_cast<size_t>(i)]);
+    if (kinetic) {
+      selfViews[i].attackPossible = kinRanges.getInRangePairs() > 0;
+      selfViews[i].inRangeCounts = &kinRanges.getInRangeCounts();
+    }
+
+    PlayerView &view = selfViews[i];
+    view.becameReady.clear();
+    view.becameIdle.clear();
+    for (int slot : readySlots[static_cast<size_t>(i)]) {
+      view.becameReady.push_back(&store.record(slot));
+    }
+    for (int slot : idleSlots[static_cast<size_t>(i)]) {
+      view.becameIdle.push_back(&store.record(slot));
+    }
+    store.pendingUnits(i, view.pendingUnits);
+  }  
 
-    ERR("fow not tested");
+  if (fogOfWar) {
 
-    // todo: optionally use qt
+    // opponent views contain copies of visible units
     
-    for (const auto &p : id2unit) {
-      if (canSee(selfViews[static_cast<size_t>(1-p.second.owner)].getUnits(), p.second)) {
-        opponentViews[static_cast<size_t>(p.second.owner)].addUnit(p.second);
+    for (int i=0; i < store.size(); ++i) {
+      if (isVisible(i)) {
+        const Unit &u = store.record(i);
+        opponentViews[static_cast<size_t>(1-u.owner)].addUnit(u);
       }
     }
 
   } else {
 
     // no fog of war
-    opponentViews[0] = selfViews[1];
-    opponentViews[1] = selfViews[0];
+    opponentViews[0].setUnits(store.getUnits(1), store.getMaxRadius(1), index[1]);
+    opponentViews[1].setUnits(store.getUnits(0), store.getMaxRadius(0), index[0]);
   }
 }
 
-using MapIterType = map<int,Unit>::iterator;
-
-// compare map iterators (by address they point to)
-bool operator<(const MapIterType &a, const MapIterType &b)
-{
-  return &*a < &*b;
-}
-
 void World::executeAttacks()
 {
   Timer start;
@@ -240,33 +234,35 @@ void World::executeAttacks()
       int fromId = a.first;
       int toId = act.attackTargetId;
       
-      auto fromIt = id2unit.find(fromId);
+      int fromSlot = store.slotOf(fromId);
       
-      if (fromIt == end(id2unit)) {
+      if (fromSlot < 0) {
         DPRINT("attack: unknown from id " << fromId);
         continue;
       }
 
-      Unit &uFrom = fromIt->second;
+      // positions don't change during the attack phase, so the published
+      // records can be used for geometry; hot state comes from the store
+      const Unit &uFrom = store.record(fromSlot);
       
       if (uFrom.owner != p->self().playerId) {
         DPRINT("attack: not from owner " << fromId);
         continue;
       }
 
-      if (!uFrom.readyForAttack()) {
+      if (!store.readyForAttack(fromSlot)) {
         DPRINT("attack: can't attack yet " << fromId);
         continue;
       }
 
-      auto toIt = id2unit.find(toId);
+      int toSlot = store.slotOf(toId);
 
-      if (toIt == end(id2unit)) {
+      if (toSlot < 0) {
         DPRINT("attack: unknown to id " << toId);
         continue;
       }
 
-      Unit &uTo = toIt->second;
+      const Unit &uTo = store.record(toSlot);
 
       if (uTo.owner == p->self().playerId) {
         DPRINT("attack: can't self-attack " << toId);
@@ -280,7 +276,7 @@ void World::executeAttacks()
 
       // check visibility
 
-      if (!isVisible(uTo)) {
+      if (!isVisible(toSlot)) {
         DPRINT("attack: not visible " << toId);
         continue;
       }
@@ -289,14 +285,21 @@ void World::executeAttacks()
 
       DPRINT("world: attack " << uFrom.unitId << " target " << uTo.unitId);
       
-      if (uFrom.executeAttack(uTo, rndInt(4)-1)) {
+      // cooldown jitter keyed by attacker and frame: attacks can be
+      // resolved in any order
+      KeyedRNG gen = unitRng(fromId, RndPurpose::COOLDOWN);
+
+      if (store.executeAttack(fromSlot, toSlot, rndInt(4, gen)-1)) {
         killed.insert(uTo.unitId);
       }
         
       if (worldListener) { worldListener->onAttack(uFrom, uTo); }
       
-      if (uFrom.onlyAttackWhenStopped) {
-        uFrom.stopMotion();
+      if (uFrom.onlyAttackWhenStopped && store.isMoving(fromSlot)) {
+        store.stopMotion(fromSlot);
+        if (kinetic) {
+          kinRanges.invalidate(fromId);
+        }
       }
     }
   }
@@ -304,91 +307,49 @@ void World::executeAttacks()
   // remove dead objects
 
   for (auto id : killed) {
-    if (worldListener) { worldListener->onKill(id2unit.find(id)->second); }
-    id2unit.erase(id);
-  }
 
-  Timer end;
-  
-  if (worldListener) { worldListener->onAttacksDone(); }
-}
-
-
-void World::moveUnit(Unit &u)
-{
-  if (!u.isMoving()) {
-    return;
-  }
+    int slot = store.slotOf(id);
+    const Unit &u = store.record(slot);
+    
+    if (worldListener) { worldListener->onKill(u); }
 
-  DPRINT("world: moving unit " << u.unitId);
-  
-  fp_t dx = u.delta.x;
-  fp_t dy = u.delta.y;
+    if (indexesValid && !indexes[static_cast<size_t>(u.owner)].remove(&u)) {
+      ERR("world: killed unit not in spatial index " << id);
+    }
 
-  if (u.moveCount == 1) {
-    // last step
-    dx = u.targetPos.x - u.pos.x;
-    dy = u.targetPos.y - u.pos.y;
+    if (fogOfWar) {
+      fow.remove(id);
+    }
 
-    DPRINT("world: unit " << u.unitId << " about to stop");
-  }
-  
-  fp_t t = 1;
-  fp_t newX = u.pos.x + dx;
-  fp_t newY = u.pos.y + dy;
-  
-  //bool collision[4] = { false, false, false, false };
+    if (kinetic) {
+      kinRanges.remove(id);
+    }
+    
+    UnitStore::Relocations rel = store.remove(slot);
+    unitIds.release(id);
 
-  //cout << u.pos.x << " " << u.pos.y << " - " << new_x << " " << new_y;
+    if (indexesValid) {
 
-  // compute collision time t <= 1
-  
-  if (dx < 0 && newX - u.radius < 0) {
-    // cout << " LEFT " << newX - u.radius << endl;
-    //collision[LEFT] = true;
-    t = std::min(t, 1.0f-(newX - u.radius) / dx);
-  }
-  if (dx > 0 && newX + u.radius > width) {
-    // cout << " RIGHT " << newX + u.radius - width << endl;
-    //collision[RIGHT] = true;
-    t = std::min(t, 1.0f-(newX + u.radius - width) / dx);
-  }
-  if (dy < 0 && newY - u.radius < 0) {
-    //cout << " TOP " << newY - u.radius << endl;
-    //collision[TOP] = true;
-    t = std::min(t, 1.0f-(newY - u.radius) / dy);
-  }
-  if (dy > 0 && newY + u.radius > height) {
-    //cout << " BOTTOM " << newY + u.radius - height << endl;
-    //collision[BOTTOM] = true;
-    t = std::min(t, 1.0f-(newY + u.radius - height) / dy);
+      // unit records have moved => update index pointers
+      
+      for (int i=0; i < rel.n; ++i) {
+        const Unit *from = store.getUnits().data() + rel.from[static_cast<size_t>(i)];
+        const Unit &v = store.record(rel.to[static_cast<size_t>(i)]);
+        if (!indexes[static_cast<size_t>(v.owner)].rebind(from, &v)) {
+          ERR("world: relocated unit not in spatial index " << v.unitId);
+        }
+      }
+    }
   }
 
-  // cout << " t=" << t;
+  Timer end;
+  attackStats.update(end.diff(start));
   
-  u.pos.x += dx * t;
-  u.pos.y += dy * t;
-
-  // clip to box
-
-  if (u.pos.x - u.radius < 0     ) { u.pos.x = u.radius; }
-  if (u.pos.x + u.radius > width ) { u.pos.x = width - u.radius; }
-  if (u.pos.y - u.radius < 0     ) { u.pos.y = u.radius; }
-  if (u.pos.y + u.radius > height) { u.pos.y = height - u.radius; }
-
-  if (t < 1) {
-    // border collision
-    u.stopMotion();
-    DPRINT("world: border collision " << u.unitId);
-    
-  } else {
-
-    DPRINT("world: move step " << u.unitId << " " << (dx*t) << " " << (dy*t) << " mc " << u.moveCount);
-  }
+  if (worldListener) { worldListener->onAttacksDone(); }
 }
 
 
-void World::executeMotion()
+void World::executeMotion(bool notifyPlayers)
 {
   Timer start;
       
@@ -396,44 +357,78 @@ void World::executeMotion()
 
     for (auto &a : p->self().actions) {
 
-      auto it = id2unit.find(a.first);
+      int slot = store.slotOf(a.first);
 
-      if (it == end(id2unit)) {
+      if (slot < 0) {
         continue;  // unit gone
       }
 
-      Unit &u = it->second;
-      Action act = a.second;
+      const Action &act = a.second;
 
-      if (u.owner != p->getId()) {
+      if (store.record(slot).owner != p->getId()) {
         cerr << "unit not owned by player" << endl;
         continue;
       }
       
       if (act.type == Action::MOVE) {
 
-        u.startMotion(act.movePos);
+        store.startMotion(slot, act.movePos);
+
+        if (kinetic) {
+          kinRanges.invalidate(a.first);
+        }
 
-        DPRINT("world: exec motion " << u.unitId << " to " << act.movePos);
+        DPRINT("world: exec motion " << a.first << " to " << act.movePos);
         
       } else if (act.type == Action::STOP) {
 
-        u.stopMotion();
+        store.stopMotion(slot);
 
-        DPRINT("world: stop motion " << u.unitId);
+        if (kinetic) {
+          kinRanges.invalidate(a.first);
+        }
+
+        DPRINT("world: stop motion " << a.first);
       }
     }
   }
 
-  // move all units
+  // move all units, cooldown and motion ticks
   
-  for (auto &p : id2unit) {
-    moveUnit(p.second);
+  store.move(width, height, movedUnits, collidedUnits);
+
+  if (fogOfWar) {
+    for (auto &m : movedUnits) {
+      // only does work if unit entered another tile
+      fow.move(store.record(m.first).unitId, store.pos[static_cast<size_t>(m.first)]);
+    }
   }
 
-  // cooldown and motion ticks
-  for (auto &p : id2unit) {
-    p.second.tick();
+  // relocate moved units in indexes (cheap if they stay in their cells)
+  // note: records are published one at a time, because quadtree leaf splits
+  // read the coordinates of all points in the leaf, which must match the tree
+
+  if (indexesValid) {
+    for (auto &m : movedUnits) {
+      store.publish(m.first);
+      const Unit &u = store.record(m.first);
+      if (!indexes[static_cast<size_t>(u.owner)].update(&u, m.second.x, m.second.y)) {
+        ERR("world: moved unit not in spatial index " << u.unitId);
+      }
+    }
+  }
+
+  // make new state visible to players and listeners
+  store.publish();
+
+  for (int slot : collidedUnits) {
+    const Unit &u = store.record(slot);
+    if (kinetic) {
+      kinRanges.invalidate(u.unitId);
+    }
+    if (notifyPlayers) {
+      players[static_cast<size_t>(u.owner)]->onBorderCollision(u.unitId);
+    }
   }
   
   Timer end;
@@ -441,12 +436,24 @@ void World::executeMotion()
 }
 
 bool World::executeFrame()
+{
+  return runFrame(nullptr);
+}
+
+bool World::replayFrame(const FrameActions &actions)
+{
+  return runFrame(&actions);
+}
+
+bool World::runFrame(const FrameActions *replay)
 {
   // compute views
 
   if (getFrameCount() == 0) {
     startTime.set();
   }
+
+  Timer frameStart;
   
   {
     Timer start;
@@ -461,31 +468,58 @@ bool World::executeFrame()
   
   if (gameFinished()) {
     if (worldListener) { worldListener->onGameEnd(); }
-    players[0]->onGameEnd();
-    players[1]->onGameEnd();
+    if (!replay) {
+      players[0]->onGameEnd();
+      players[1]->onGameEnd();
+    }
     return false;
   }
 
   if (worldListener) { worldListener->onFrame(); }
   
-  // run player code
+  // run player code - players only read views and write their own
+  // actions (and use their own rngs), so they can run concurrently
 
-  for (int i=0; i < 2; ++i) {
-    Timer start;
+  auto runPlayer = [&](int i) {
+    Timer start(Timer::THREAD_CPU);
 
-    players[i]->onFrame(frameCounter);
+    players[static_cast<size_t>(i)]->onFrame(frameCounter);
 
-    Timer end;
-    playerStats[i].update(end.diff(start));
+    Timer end(Timer::THREAD_CPU);
+    playerStats[static_cast<size_t>(i)].update(end.diff(start));
+  };
+
+  if (replay) {
+    for (size_t i=0; i < 2; ++i) {
+      selfViews[i].actions.insert((*replay)[i].begin(), (*replay)[i].end());
+    }
+  } else if (playerPool) {
+    playerPool->run(2, runPlayer);
+  } else {
+    for (int i=0; i < 2; ++i) {
+      runPlayer(i);
+    }
   }
 
   // execute actions
 
+  if (!indexes[0].isIncremental()) {
+    // rebuilt from scratch in next computeViews()
+    indexesValid = false;
+  }
+
   // attacks
   executeAttacks();
     
   // move units
-  executeMotion();
+  executeMotion(!replay);
+
+  if (spatial.autoEps) {
+    Timer frameEnd;
+    if (tuner.update(store.getUnits(), frameEnd.diff(frameStart), spatial)) {
+      setupIndexes();
+    }
+  }
 
   ++frameCounter;
   return true;
@@ -493,7 +527,7 @@ bool World::executeFrame()
 
 void World::writeStats() const
 {
-  cout << "frame " << getFrameCount() << " units " << id2unit.size();
+  cout << "frame " << getFrameCount() << " units " << store.size();
   if (getFrameCount() > 0) {
     Timer now(Timer::WALLCLOCK);
     cout << " fps " << getFrameCount() / ((double)now.diff(startTime) / 1'000'000.0);
@@ -503,6 +537,102 @@ void World::writeStats() const
   cout << "action millis: " << actionStats.avgMillis() << endl;
   cout << "attack millis: " << attackStats.avgMillis() << endl;
   cout << "motion millis: " << motionStats.avgMillis() << endl;
+  if (spatial.autoEps) {
+    cout << "tuned spatial: " << SpatialParams::typeToString(spatial.type)
+         << " qteps " << spatial.qtEps << endl;
+  }
+  if (kinetic) {
+    cout << "kinetic events: " << kinRanges.getEvents() << " replans: " << kinRanges.getReplans()
+         << " pairs: " << kinRanges.getPairs() << " quiet frames: " << kinRanges.getQuietFrames()
+         << endl;
+  }
+  if (spatial.useIndex()) {
+    cout << SpatialParams::typeToString(spatial.type) << " allocs since rebuild: "
+         << indexes[0].getAllocs() << " " << indexes[1].getAllocs() << endl;
+  }
   cout << "player " << players[0]->getName() << " millis: " << playerStats[0].avgMillis() << endl;
   cout << "player " << players[1]->getName() << " millis: " << playerStats[1].avgMillis() << endl;  
+  cout << "state hash: " << hex << getStateHash() << dec << endl;
+}
+
+
+void World::writeState(Serial::Writer &w) const
+{
+  size_t at = w.begin(Serial::STATE);
+
+  Serial::StateHeader h;
+  memset(&h, 0, sizeof(h));
+  h.frame = frameCounter;
+  h.width = width;
+  h.height = height;
+  h.fogOfWar = fogOfWar;
+  h.seed = seed;
+  h.idBound = unitIds.getBound();
+  h.freeIdCount = static_cast<int32_t>(unitIds.getFreeIds().size());
+  h.paramsLength = static_cast<uint32_t>(params.size());
+  h.rngSize = sizeof(rng);
+
+  // unit records go straight into the buffer
+  size_t n = static_cast<size_t>(store.size());
+  size_t hAt = w.size();
+  w.extend(sizeof(h));
+  w.put(params.data(), params.size());
+  w.put(rng);
+  w.put(unitIds.getFreeIds().data(), unitIds.getFreeIds().size());
+  char *records = w.extend(n * sizeof(Serial::UnitRecord));
+  store.writeState(h, records);
+  w.overwrite(hAt, h);
+
+  w.finish(at);
+}
+
+
+void World::readState(Serial::Reader &r)
+{
+  if (players.size() != 2) {
+    ERR("World: readState before setup");
+  }
+
+  Serial::StateHeader h;
+  r.get(h);
+
+  if (h.rngSize != sizeof(rng)) {
+    ERR("World: rng state size mismatch");
+  }
+  if (h.freeIdCount < 0 || h.idBound < 0 || h.unitCount < 0) {
+    ERR("World: bad counts in state");
+  }
+
+  width = h.width;
+  height = h.height;
+  fogOfWar = h.fogOfWar != 0;
+  seed = h.seed;
+  frameCounter = h.frame;
+  params.assign(r.skip(h.paramsLength), h.paramsLength);
+  r.get(rng);
+
+  vector<int> freeIds(static_cast<size_t>(h.freeIdCount));
+  r.get(freeIds.data(), freeIds.size());
+  unitIds.restore(h.idBound, freeIds);
+
+  store.readState(h, r.skip(static_cast<size_t>(h.unitCount) * sizeof(Serial::UnitRecord)));
+
+  // derived state
+
+  tuner.setup(spatial, width, height);
+  setupIndexes();
+  fow.setup(width+1, height+1);
+  kinRanges.setup(width, height);
+
+  for (const Unit &u : store.getUnits()) {
+    if (u.unitId >= h.idBound) {
+      ERR("World: unit id " << u.unitId << " out of range in state");
+    }
+    if (fogOfWar) {
+      fow.add(u);
+    }
+    if (kinetic) {
+      kinRanges.add(u);
+    }
+  }
 }
@@ -1,11 +1,17 @@
 #pragma once
 
 #include <vector>
-#include <map>
 #include "PlayerView.h"
 #include "WorldListener.h"
 #include "Unit.h"
-#include "Quadtree.h"
+#include "UnitStore.h"
+#include "SpatialIndex.h"
+#include "SpatialTuner.h"
+#include "FogOfWar.h"
+#include "KineticRanges.h"
+#include "ThreadPool.h"
+#include "IdAllocator.h"
+#include <memory>
 
 class Player;
 
@@ -22,7 +28,11 @@ public:
   {
     width = height = 0;
     fogOfWar = false;
+    kinetic = false;
     frameCounter = 0;
+    seed = 0;
+    indexesValid = false;
+    worldListener = nullptr;
   }
 
   virtual ~World()
@@ -33,11 +43,18 @@ public:
   // @return false if game is over
   bool executeFrame();
 
+  // unit id -> action, per player
+  using FrameActions = std::array<std::vector<std::pair<int, Action>>, 2>;
+
+  // same, but execute recorded actions instead of running the players
+  // (players aren't called at all, the listener is)
+  bool replayFrame(const FrameActions &actions);
+
   // setup world
-  // qtEps: cell split dimension of quadtree (0: don't use qt)
+  // spatial: index world maintains for each player (handed to players)
   virtual void setup(fp_t width_, fp_t height_, bool fogOfWar_, int seed_,
                      Player *p0, Player *p1,
-                     fp_t qtEps,
+                     const SpatialParams &spatial,
                      const std::string &params);
   
   virtual bool gameFinished() const = 0;
@@ -47,6 +64,16 @@ public:
   // called when unit gets attacked by another (e.g. for animating attacks in a GUI)
   // virtual void onAttack(const Unit &/*from*/, const Unit &/*to*/) { } 
 
+  // predict attack range events to let players skip range queries
+  // (call before setup)
+  void setKinetic(bool on) { kinetic = on; }
+
+  // run players' onFrame concurrently on that many threads (1: in turn)
+  void setPlayerThreads(int n)
+  {
+    playerPool.reset(n > 1 ? new ThreadPool(n) : nullptr);
+  }
+
   void setListener(WorldListener *wl)
   {
     worldListener = wl;
@@ -67,6 +94,9 @@ public:
     return Vec2(width-pos.x, height-pos.y);
   }
 
+  // draws from the world's stream (e.g. for setup); draws during the game
+  // should use unitRng()
+
   // random integer [0,n)
   int rndInt(int n) const { return rndInt(n, rng); }
 
@@ -80,50 +110,120 @@ public:
   // avoiding edge close to now
   Vec2 rndEdgePos(fp_t radius, const Vec2 &now) const { return rndEdgePos(radius, now, rng); }
 
-  // similar, but using external rng
+  // generator for the simulation's draws concerning unit in the current
+  // frame: independent of the order in which units are processed
+  KeyedRNG unitRng(int unitId, RndPurpose purpose) const
+  {
+    return KeyedRNG(seed, static_cast<uint64_t>(frameCounter), static_cast<uint64_t>(unitId), purpose);
+  }
+
+  // similar, but using external 64-bit generator (KeyedRNG)
   
   // integer [0,n)
-  int rndInt(int n, RNG &rng) const;
+  template <typename Gen>
+  int rndInt(int n, Gen &gen) const;
 
   // double [0,1)
-  fp_t rnd01(RNG &rnd) const;
+  template <typename Gen>
+  fp_t rnd01(Gen &gen) const;
 
   // random location for circle that fits
-  Vec2 rndPos(fp_t radius, RNG &rng) const;
+  template <typename Gen>
+  Vec2 rndPos(fp_t radius, Gen &gen) const;
 
   // return a random position at which a circle of that radius fits along an edge
   // avoiding edge close to now
-  Vec2 rndEdgePos(fp_t radius, const Vec2 &now, RNG &rng) const;
+  template <typename Gen>
+  Vec2 rndEdgePos(fp_t radius, const Vec2 &now, Gen &gen) const;
 
   int getFrameCount() const { return frameCounter; }
+
+  // hash of the simulation state after getFrameCount() frames: units' dynamic
+  // state and frame counter (not the rng); maintained incrementally, so it
+  // can be checked every frame (e.g. to compare runs or replays)
+  uint64_t getStateHash() const
+  {
+    return mix64(store.getStateHash() ^ mix64(static_cast<uint64_t>(frameCounter)));
+  }
   
   fp_t getWidth() const { return width; }
   fp_t getHeight() const { return height; }  
 
-  using UnitMap = std::map<int, Unit>;
-  
-  const UnitMap &getUnits() const { return id2unit; }
+  // all live units (in slot order, state as of end of last frame)
+  const std::vector<Unit> &getUnits() const { return store.getUnits(); }
+
+  // unit with id unitId, nullptr if not present
+  const Unit *findUnit(int unitId) const
+  {
+    int slot = store.slotOf(unitId);
+    return slot < 0 ? nullptr : &store.record(slot);
+  }
+
+  // adds copy of u with a new unit id
+  // @return that id
+  int addUnit(Unit u)
+  {
+    u.unitId = unitIds.alloc();
+    store.add(u);
+    indexesValid = false;
+    if (fogOfWar) {
+      fow.add(u);
+    }
+    if (kinetic) {
+      kinRanges.add(u);
+    }
+    return u.unitId;
+  }
+
+  std::pair<int, int> countUnits() const { return store.countUnits(); }
+
+  // index parameters currently in use (changing if auto tuned)
+  const SpatialParams &getSpatial() const { return spatial; }
 
-  void addUnit(const Unit &u) { id2unit.insert({ u.unitId, u }); }
+  // append simulation state between frames as STATE chunk (see Serial.h):
+  // units, unit ids, frame counters, and rng; not included: player state
+  // and spatial tuner state (a restored tuner starts over)
+  void writeState(Serial::Writer &w) const;
 
-  std::pair<int, int> countUnits() const;
+  // replace simulation state by STATE payload r points to (after its
+  // chunk header); world must have been set up with the same players
+  void readState(Serial::Reader &r);
   
 private:
   
   fp_t width, height;
   bool fogOfWar;
-  fp_t qtEps;
+  SpatialParams spatial;
   int frameCounter;
   std::vector<Player*> players;
   std::string params;
-  std::array<TimeStats, 2> playerStats;
+  std::array<TimeStats, 2> playerStats; // thread cpu time
+  std::unique_ptr<ThreadPool> playerPool; // nullptr: players run in turn
   TimeStats viewStats, actionStats, motionStats, attackStats;
   Timer startTime;
   
-  UnitMap id2unit;
-  std::array<Quadtree<Unit>, 2> qts;
+  UnitStore store;
+  IdAllocator unitIds;  // ids of dead units are reused
+
+  // per player index over unit records, maintained incrementally
+  // (rebuilt only after units have been added)
+  std::array<SpatialIndex<Unit>, 2> indexes;
+  bool indexesValid;
+  std::vector<std::pair<int, Vec2>> movedUnits; // slot, old position
+  std::vector<int> collidedUnits; // slots of units stopped at border
+  std::array<std::vector<int>, 2> readySlots, idleSlots; // became ready / idle
+  SpatialTuner tuner;  // used if spatial.autoEps
+
+  // visibility of unit in slot i to opponent, valid if visibleKnown[i];
+  // reset in each frame, computed for all units with fog of war (tile
+  // lookup), otherwise on demand
+  Bitset visible, visibleKnown;
+  FogOfWar fow; // maintained if fogOfWar
+  bool kinetic;
+  KineticRanges kinRanges; // maintained if kinetic
     
-  mutable RNG rng; // to generate random numbers local to simulation
+  int seed;
+  mutable KeyedRNG rng; // stream for setup (key: seed, SETUP)
 
   WorldListener *worldListener;
   
@@ -133,20 +233,37 @@ private:
 
   // map?
 
+  void rebuildIndexes();
+
+  // set up indexes for current spatial params
+  void setupIndexes();
+  
+  void computeVisibility();
+  void computeVisibility(int slot);
   void computeViews();
   void executeActions();
   
   void executeAttacks();
-  void executeMotion();
-  void moveUnit(Unit &u);
+  void executeMotion(bool notifyPlayers);
+
+  // executeFrame() if replay is nullptr, else replayFrame(*replay)
+  bool runFrame(const FrameActions *replay);
 
 public:
 
-  // can u be seen by opponent units?
-  bool isVisible(const Unit &u);
+  // can unit in slot be seen by opponent units?
+  // (evaluated at most once per frame; valid until motion is executed)
+  bool isVisible(int slot)
+  {
+    size_t i = static_cast<size_t>(slot);
+    if (!visibleKnown.test(i)) {
+      computeVisibility(slot);
+    }
+    return visible.test(i);
+  }
 
   // can one unit in units see u?
-  static bool canSee(const std::vector<Unit> &units, const Unit &u);
+  static bool canSee(Span<Unit> units, const Unit &u);
 
   // can from attck to? (without considering visibility)
   static bool canAttack(const Unit &from, const Unit &to);
@@ -154,3 +271,90 @@ public:
   void writeStats() const;
 };
 
+
+// draws are mapped with plain integer arithmetic instead of std
+// distributions: no distribution objects per call, and the same numbers with
+// every standard library
+
+// integer [0,n): high 32 bits scaled to n (bias < n / 2^32)
+template <typename Gen>
+int World::rndInt(int n, Gen &gen) const
+{
+  static_assert(Gen::min() == 0 && Gen::max() == ~uint64_t(0), "64-bit generator");
+  assert(n > 0);
+  int r = static_cast<int>(((gen() >> 32) * static_cast<uint64_t>(n)) >> 32);
+  assert(r >= 0 && r < n);
+  return r;
+}
+
+// [0,1): high 24 bits (exact in float, can't round up to 1)
+template <typename Gen>
+fp_t World::rnd01(Gen &gen) const
+{
+  static_assert(Gen::min() == 0 && Gen::max() == ~uint64_t(0), "64-bit generator");
+  fp_t r = static_cast<fp_t>(gen() >> 40) * (1.0f / 16777216.0f);
+  assert(r >= 0 && r < 1);
+  return r;
+}
+
+template <typename Gen>
+Vec2 World::rndPos(fp_t radius, Gen &gen) const
+{
+  fp_t slack = radius * 1.1f;
+
+  Vec2 p((width  - 2*slack) * rnd01(gen) + slack,
+         (height - 2*slack) * rnd01(gen) + slack);
+  
+  // assert circle in rectangle
+  assert(p.x > radius && p.x < width - radius);
+  assert(p.y > radius && p.y < height - radius);
+  return p;
+}
+
+template <typename Gen>
+Vec2 World::rndEdgePos(fp_t radius, const Vec2 &now, Gen &gen) const
+{
+  fp_t slack = radius * 1.05f;
+  fp_t xLow = width  * 0.05f, xHigh = width  * 0.95f;
+  fp_t yLow = height * 0.05f, yHigh = height * 0.95f;
+  Vec2 p;
+
+  if (rnd01(gen) < 0.5f) {
+    
+    // constrain y
+    
+    p.x = (width - 2*slack) * rnd01(gen) + slack;
+
+    if (now.y < yLow) {
+      p.y = height - slack;
+    } else if (now.y > yHigh) {
+      p.y = slack;
+    } else if (rnd01(gen) < 0.5f) {
+      p.y = slack;
+    } else {
+      p.y = height - slack;
+    }
+    
+  } else {
+    
+    // constain x
+
+    p.y = (height - 2*slack) * rnd01(gen) + slack;
+
+    if (now.x < xLow) {
+      p.x = width - slack;
+    } else if (now.x > xHigh) {
+      p.x = slack;
+    } else if (rnd01(gen) < 0.5f) {
+      p.x = slack;
+    } else {
+      p.x = width - slack;
+    }
+  }
+    
+  // assert circle in rectangle
+  assert(p.x > radius && p.x < width - radius);
+  assert(p.y > radius && p.y < height - radius);
+  return p;
+}
+
@@ -0,0 +1,131 @@
+/*
+
+  csim_batch: plays many independent games on a thread pool
+
+  reads game specs from a file (or stdin), one per line, written as csim
+  options, e.g.
+
+    --wpar "50 50" --seed 3 --rpar attack_weakest --spatial grid
+
+  (empty lines and lines starting with # are skipped) and writes one result
+  line per game, in input order:
+
+    game <i> ; steps <frames> ; RED score: <score> ; timeout <0|1> ; millis <wall time> ; hash <final state hash>
+
+  each thread plays one game at a time; games share nothing (each has its
+  own world, players, rngs, and unit ids), so results don't depend on the
+  number of threads
+
+ */
+
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <boost/program_options.hpp>
+
+#include "Game.h"
+#include "RangeKernels.h"
+#include "ThreadPool.h"
+
+using namespace std;
+namespace po = boost::program_options;
+
+
+static void writeResult(ostream &os, size_t i, const GameResult &r)
+{
+  os << "game " << i
+     << " ; steps " << r.frames
+     << " ; RED score: " << r.score0
+     << " ; timeout " << r.timeout
+     << " ; millis " << r.millis
+     << " ; hash " << hex << r.hash << dec
+     << endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+  po::options_description desc("Options");
+
+  desc.add_options()
+    ("help", "produce help message")
+    ("games", po::value<string>()->default_value("-"), "file with one game spec (csim options) per line (-: stdin)")
+    ("threads,t", po::value<int>()->default_value(0), "number of threads playing games (0: all cores)")
+    ("simd", po::value<string>()->default_value("auto"), "set SIMD level of range and motion kernels (auto|scalar|sse2|avx2|avx512)");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    cout << desc << "\n";
+    return 1;
+  }
+
+  string gamesFile = vm["games"].as<string>();
+  int threads = vm["threads"].as<int>();
+
+  if (threads <= 0) {
+    threads = max(static_cast<int>(thread::hardware_concurrency()), 1);
+  }
+
+  // selected once, before any game runs
+  RangeKernels::select(RangeKernels::levelFromString(vm["simd"].as<string>()));
+
+  // read all specs first, so that errors show up before playing
+
+  vector<GameSpec> specs;
+
+  {
+    ifstream file;
+    istream *is = &cin;
+
+    if (gamesFile != "-") {
+      file.open(gamesFile);
+      if (!file) {
+        ERR("can't open " << gamesFile);
+      }
+      is = &file;
+    }
+
+    string line;
+
+    for (int lineNum=1; getline(*is, line); ++lineNum) {
+
+      size_t first = line.find_first_not_of(" \t\r");
+
+      if (first == string::npos || line[first] == '#') {
+        continue;
+      }
+
+      specs.push_back(Game::specFromArgs(line, "line " + to_string(lineNum)));
+    }
+  }
+
+  // play; results are written as soon as all earlier games are done
+
+  vector<GameResult> results(specs.size());
+  vector<bool> finished(specs.size(), false);
+  size_t written = 0;
+  mutex outMutex;
+  ThreadPool pool(threads);
+
+  pool.run(static_cast<int>(specs.size()), [&](int i) {
+
+    size_t k = static_cast<size_t>(i);
+    Game game(specs[k]);
+    GameResult r = game.run();
+
+    lock_guard<mutex> lock(outMutex);
+    results[k] = r;
+    finished[k] = true;
+
+    for (; written < specs.size() && finished[written]; ++written) {
+      writeResult(cout, written, results[written]);
+    }
+  });
+
+  return 0;
+}
@@ -0,0 +1,219 @@
+/*
+
+  Spatial index microbenchmark ("csim_bench_spatial")
+
+  sweeps map sizes, unit counts, qteps values, and index types and writes
+  one CSV line per configuration:
+
+    type,map,units,qteps,cellsize,insert_us,query_us,cands_per_query,bytes
+
+  insert_us: time for (re)building the index over all units
+  query_us:  time per range query (attack range of a tank around a unit)
+  bytes:     index memory footprint after the last build
+
+  units are placed uniformly at random on a (map x map) square; point sets
+  and query centers only depend on --seed, map, and units, so runs are
+  comparable across index types and versions
+
+  --test runs quadtreeTest() (quadtree, linear quadtree and grid queries
+  compared against brute force)
+  and rangeKernelsTest() (vector kernels compared against scalar code)
+
+ */
+
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <boost/program_options.hpp>
+
+#include "Global.h"
+#include "SpatialIndex.h"
+#include "RangeKernels.h"
+
+using namespace std;
+namespace po = boost::program_options;
+
+struct BenchPoint
+{
+  fp_t x, y;
+
+  fp_t getX() const { return x; }
+  fp_t getY() const { return y; }
+};
+
+template <typename T>
+static vector<T> parseList(const string &s)
+{
+  vector<T> v;
+  istringstream is(s);
+  T x;
+
+  while (is >> x) {
+    v.push_back(x);
+  }
+
+  if (!is.eof()) {
+    ERR("bench: can't parse list '" << s << "'");
+  }
+  return v;
+}
+
+static fp_t rnd01(RNG &rng)
+{
+  std::uniform_real_distribution<fp_t> dist(0, 1); // range [0,1)
+  return dist(rng);
+}
+
+static void runConfig(SpatialParams::Type type, fp_t map, const vector<BenchPoint> &points,
+                      const vector<BenchPoint> &centers, fp_t qtEps, fp_t cellSize,
+                      int reps)
+{
+  // tank attack range + radius
+  constexpr fp_t R = 7*32 + 16;
+
+  SpatialParams params(type, qtEps, cellSize);
+  SpatialIndex<BenchPoint> index;
+
+  // larger to accomodate max coordinates (like World)
+  index.setup(params, map+1, map+1);
+
+  Timer insertStart;
+
+  for (int r=0; r < reps; ++r) {
+    index.build(points);
+  }
+
+  Timer insertEnd;
+
+  vector<const BenchPoint*> result;
+  size_t cands = 0;
+
+  Timer queryStart;
+
+  for (int r=0; r < reps; ++r) {
+    for (const auto &c : centers) {
+
+      if (type == SpatialParams::BF) {
+        result.clear();
+        for (const auto &p : points) {
+          if (p.x >= c.x - R && p.x < c.x + R && p.y >= c.y - R && p.y < c.y + R) {
+            result.push_back(&p);
+          }
+        }
+      } else {
+        index.query(c.x - R, c.x + R, c.y - R, c.y + R, result);
+      }
+
+      cands += result.size();
+    }
+  }
+
+  Timer queryEnd;
+
+  double queries = static_cast<double>(reps) * static_cast<double>(centers.size());
+
+  cout << SpatialParams::typeToString(type) << ","
+       << map << ","
+       << points.size() << ","
+       << (type == SpatialParams::QT ? qtEps : 0) << ","
+       << (type == SpatialParams::GRID ? cellSize : 0) << ","
+       << static_cast<double>(insertEnd.diff(insertStart)) / reps << ","
+       << static_cast<double>(queryEnd.diff(queryStart)) / queries << ","
+       << static_cast<double>(cands) / queries << ","
+       << index.getBytes()
+       << endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+  po::options_description desc("Options");
+
+  desc.add_options()
+    ("help", "produce help message")
+    ("maps", po::value<string>()->default_value("2048 16384 65536"), "map side lengths")
+    ("units", po::value<string>()->default_value("1000 2000 4000 8000"), "units per index")
+    ("qteps", po::value<string>()->default_value("200 800 3200"), "quadtree split epsilons")
+    ("types", po::value<string>()->default_value("bf qt grid lqt"), "index types")
+    ("cellsize", po::value<fp_t>()->default_value(320), "grid cell size")
+    ("queries", po::value<int>()->default_value(1000), "queries per repetition")
+    ("reps", po::value<int>()->default_value(10), "repetitions")
+    ("seed,s", po::value<int>()->default_value(1), "rng seed")
+    ("test", po::bool_switch()->default_value(false), "run quadtree and range kernel tests and exit");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    cout << desc << "\n";
+    return 1;
+  }
+
+  if (vm["test"].as<bool>()) {
+    quadtreeTest();
+    cout << endl << "quadtree test passed" << endl;
+    rangeKernelsTest();
+    cout << endl << "range kernels test passed" << endl;
+    return 0;
+  }
+
+  vector<fp_t> maps = parseList<fp_t>(vm["maps"].as<string>());
+  vector<int> unitCounts = parseList<int>(vm["units"].as<string>());
+  vector<fp_t> qtEpss = parseList<fp_t>(vm["qteps"].as<string>());
+  vector<string> typeNames = parseList<string>(vm["types"].as<string>());
+  fp_t cellSize = vm["cellsize"].as<fp_t>();
+  int queries = vm["queries"].as<int>();
+  int reps = vm["reps"].as<int>();
+  int seed = vm["seed"].as<int>();
+
+  if (queries <= 0 || reps <= 0) {
+    ERR("bench: queries and reps must be positive");
+  }
+
+  vector<SpatialParams::Type> types;
+  for (const auto &s : typeNames) {
+    types.push_back(SpatialParams::typeFromString(s));
+  }
+
+  cout << "type,map,units,qteps,cellsize,insert_us,query_us,cands_per_query,bytes" << endl;
+
+  for (fp_t map : maps) {
+    for (int n : unitCounts) {
+
+      if (n <= 0) {
+        ERR("bench: unit counts must be positive");
+      }
+
+      // same points and queries for all index types
+
+      RNG rng;
+      rng.seed(static_cast<unsigned long>(seed));
+
+      vector<BenchPoint> points;
+      for (int i=0; i < n; ++i) {
+        points.push_back({ rnd01(rng) * map, rnd01(rng) * map });
+      }
+
+      vector<BenchPoint> centers;
+      for (int i=0; i < queries; ++i) {
+        centers.push_back(points[static_cast<size_t>(rnd01(rng) * static_cast<fp_t>(n)) % points.size()]);
+      }
+
+      for (auto type : types) {
+        if (type == SpatialParams::QT) {
+          for (fp_t eps : qtEpss) {
+            if (eps <= 0) {
+              ERR("bench: qteps must be positive");
+            }
+            runConfig(type, map, points, centers, eps, cellSize, reps);
+          }
+        } else {
+          runConfig(type, map, points, centers, 800, cellSize, reps);
+        }
+      }
+    }
+  }
+
+  return 0;
+}
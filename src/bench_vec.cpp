@@ -0,0 +1,88 @@
+/*
+
+  csim_bench_vec: VecWorld throughput (env steps per second)
+
+  steps n small games in lockstep; units of extern players (--rplayer
+  Extern / --bplayer Extern) that are idle get random move orders
+
+ */
+
+#include <iostream>
+#include <random>
+#include <boost/program_options.hpp>
+
+#include "VecWorld.h"
+#include "RangeKernels.h"
+
+using namespace std;
+namespace po = boost::program_options;
+
+int main(int argc, char *argv[])
+{
+  po::options_description desc("Options");
+
+  desc.add_options()
+    ("help", "produce help message")
+    ("envs,n", po::value<int>()->default_value(256), "number of worlds")
+    ("threads,t", po::value<int>()->default_value(1), "number of threads (including main thread)")
+    ("vsteps", po::value<int>()->default_value(1000), "number of VecWorld steps");
+
+  Game::addOptions(desc);
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    cout << desc << "\n";
+    return 1;
+  }
+
+  GameSpec spec = Game::specFromOptions(vm);
+  int n = vm["envs"].as<int>();
+  int threads = vm["threads"].as<int>();
+  int vsteps = vm["vsteps"].as<int>();
+
+  RangeKernels::select(RangeKernels::levelFromString("auto"));
+
+  VecWorld vw(spec, n, threads);
+  RNG rng(static_cast<unsigned>(spec.seed));
+  std::uniform_real_distribution<float> rx(0, spec.width), ry(0, spec.height);
+  size_t rows = static_cast<size_t>(vw.getMaxUnits());
+  bool externRed = spec.redPlayer == "Extern", externBlue = spec.bluePlayer == "Extern";
+  double rewardSum = 0;
+
+  Timer start(Timer::WALLCLOCK);
+
+  for (int s=0; s < vsteps; ++s) {
+
+    const float *obs = vw.getObservations();
+    VecWorld::UnitAction *acts = vw.getActions();
+
+    for (size_t r=0; r < static_cast<size_t>(n) * rows; ++r, obs += VecWorld::FEATURES) {
+
+      bool ext = obs[VecWorld::OWNER] == 0 ? externRed : externBlue;
+
+      if (obs[VecWorld::ALIVE] != 0 && ext && obs[VecWorld::MOVING] == 0) {
+        acts[r].type = Action::MOVE;
+        acts[r].x = rx(rng);
+        acts[r].y = ry(rng);
+      }
+    }
+
+    vw.step();
+
+    for (int i=0; i < n; ++i) {
+      rewardSum += vw.getRewards()[i];
+    }
+  }
+
+  Timer end(Timer::WALLCLOCK);
+  double secs = static_cast<double>(end.diff(start)) / 1'000'000.0;
+
+  cout << "envs " << n << " threads " << threads << " max units " << rows
+       << " env steps " << vw.getSteps() << " games " << vw.getEpisodes()
+       << " RED score sum " << rewardSum << endl;
+  cout << "env steps/s " << static_cast<double>(vw.getSteps()) / secs << endl;
+  return 0;
+}
@@ -14,38 +14,33 @@
 #include <cstdlib>
 #include <cmath>
 #include <iostream>
-#include <sstream>
-#include <cstring>
-#include <chrono>
 #include <boost/program_options.hpp>
 #include <GL/glut.h>
 
-#include "World.h"
-#include "Player.h"
+#include "Game.h"
 #include "Gfx.h"
-#include "Unit.h"
-#include "UnitTypes.h"
-#include "P_IndCtrl.h"
-#include "W_Plain.h"
+#include "RangeKernels.h"
+#include "Replay.h"
 
 using namespace std;
 namespace po = boost::program_options;
 
-// global => glut functions can access it
+// global => glut functions can access it
 
-World *world = nullptr;
-Player *pRed, *pBlue;
-int maxSteps = 0;
+Game *game = nullptr;     // owned by replay if replaying
+Replay *replay = nullptr; // nullptr: live game
 int delay = 0; // frame delay in ms
 Gfx *gfx = nullptr;
 
 
 static void cleanup()
 {
-  delete pRed;
-  delete pBlue;
   delete gfx;
-  delete world;
+  if (replay) {
+    delete replay;
+  } else {
+    delete game;
+  }
 }
 
 
@@ -53,7 +48,9 @@ static void execStep()
 {
   cout << "." << flush;
 
-  if (world->getFrameCount() < maxSteps && world->executeFrame()) {
+  World *world = &game->getWorld();
+  
+  if (replay ? replay->step() : game->step()) {
     
     if ((world->getFrameCount() % 100) == 0) {
       cout << endl;
@@ -73,25 +70,34 @@ static void execStep()
     cout << "display millis: " << gfx->displayStats.avgMillis() << endl;
   }
 
-  int rScore = world->score0(world->getFrameCount() >= maxSteps);
+  GameResult r = game->result();
   
-  cout << "### game over after " << world->getFrameCount()
+  cout << "### game over after " << r.frames
        << " step(s) ; RED score: "
-       << rScore;
+       << r.score0;
 
-  if (rScore > 0) {
+  if (r.score0 > 0) {
     cout << " ; RED-wins";
-  } else if (rScore == 0) {
+  } else if (r.score0 == 0) {
     cout << " ; tie";
   } else {
     cout << " ; BLUE-wins";
   }
 
-  if (world->getFrameCount() >= maxSteps) {
+  if (r.timeout) {
     cout << " ; timeout ";
   }
   cout << endl;
 
+  if (replay) {
+    if (replay->getFirstMismatch() >= 0) {
+      cout << "replay: state first differs from recording after "
+           << replay->getFirstMismatch() << " frames" << endl;
+    } else {
+      cout << "replay: state hashes match recording" << endl;
+    }
+  }
+
   cleanup();
   exit(0);
 }
@@ -102,40 +108,6 @@ void timerFunction(int)
   glutTimerFunc((unsigned int)delay, timerFunction, 0);
 }
 
-static World *newWorld(const string &worldType)
-{
-  if (worldType == "Plain") {
-
-    return new W_Plain();
-
-  } else {
-
-    ERR("unknown world type '" << worldType << "'");
-    
-  }
-
-  return nullptr;
-}
-
-
-static Player *newPlayer(const string &playerType, World *world,
-                         int index, const string &playerName,
-                         fp_t qtEps,
-                         const string &params, int seed)
-{
-  if (playerType == "IndCtrl") {
-
-    return new P_IndCtrl(world, index, playerName, qtEps, params, seed);
-    
-  } else {
-
-    ERR("unknown player type '" << playerType << "'");
-
-  }
-  
-  return nullptr;
-}
-
 
 void onDisplay()
 {
@@ -145,31 +117,22 @@ void onDisplay()
 
 int main(int argc, char *argv[])
 {
-#if 0
-  // test quadtree
-  quadtreeTest();
-  exit(0);
-#endif
-  
   // Declare the supported options
   po::options_description desc("Options");
 
   desc.add_options()
-    ("help", "produce help message")
-    ("world", po::value<string>()->default_value("Plain"), "set world type")
-    ("wpar", po::value<string>()->default_value("100 100"), "set world parameters")
-    ("width,w", po::value<fp_t>()->default_value(800), "set world width")
-    ("height,h", po::value<fp_t>()->default_value(800), "set world height")
-    ("fow", po::bool_switch()->default_value(false), "swtich fog of war on")
-    ("qteps", po::value<fp_t>()->default_value(800), "set quadtree split epsilon (0: no qt, 800 good for large W_Plain)")
+    ("help", "produce help message");
+
+  Game::addOptions(desc);
+
+  desc.add_options()
     ("delay,d", po::value<int>()->default_value(50), "set frame delay (ms)")
-    ("seed,s", po::value<int>()->default_value(0), "set rng seed (0:time)")
-    ("rplayer", po::value<string>()->default_value("IndCtrl"), "set red player")
-    ("bplayer", po::value<string>()->default_value("IndCtrl"), "set blue player")
-    ("rpar,r", po::value<string>()->default_value("attack_closest"), "set red parameters (attack_non|closest|weakest|most_dangerous)")
-    ("bpar,b", po::value<string>()->default_value("attack_closest"), "set blue parameters (attack_non|closest|weakest|most_dangerous)")
-    ("steps", po::value<int>()->default_value(-1), "maximum steps (-1: infinite)")
-    ("graphics,g", po::value<double>()->default_value(0.0), "graphics scaling factor (0: no gfx)");
+    ("graphics,g", po::value<double>()->default_value(0.0), "graphics scaling factor (0: no gfx)")
+    ("simd", po::value<string>()->default_value("auto"), "set SIMD level of range and motion kernels (auto|scalar|sse2|avx2|avx512)")
+    ("record", po::value<string>(), "write replay of the game to file")
+    ("keyframes", po::value<int>()->default_value(1000), "frames between full states in replay file")
+    ("replay", po::value<string>(), "replay game from file (game options are ignored)")
+    ("seek", po::value<int>()->default_value(0), "start replay at that frame");
 
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -180,49 +143,24 @@ int main(int argc, char *argv[])
     return 1;
   }
 
-  string worldType = vm["world"].as<string>();
-  string wPar = vm["wpar"].as<string>();
-  
-  fp_t width = vm["width"].as<fp_t>();
-  fp_t height = vm["height"].as<fp_t>();
-
-  bool fow = vm["fow"].as<bool>();
-  fp_t qtEps = vm["qteps"].as<fp_t>();
-  
-  delay = vm["delay"].as<int>(); // frame delay in ms
-  int seed = vm["seed"].as<int>();   // for rng, 0: use time
+  if (vm.count("replay")) {
+    // players aren't run, so thread options don't apply
+    replay = new Replay(vm["replay"].as<string>());
+    game = &replay->getGame();
+  }
 
-  string redPlayer = vm["rplayer"].as<string>();
-  string bluePlayer = vm["bplayer"].as<string>();
-  
-  string rPar = vm["rpar"].as<string>();
-  string bPar = vm["bpar"].as<string>();
+  GameSpec spec = replay ? replay->getRecordedSpec() : Game::specFromOptions(vm);
   
-  int steps = vm["steps"].as<int>();
+  delay = vm["delay"].as<int>(); // frame delay in ms
   double gfxScale = vm["graphics"].as<double>();
-  
-  if (seed == 0) {
-    // rng seed dependent on wallclock time
-    auto millis =
-      std::chrono::duration_cast<std::chrono::milliseconds>
-      (std::chrono::system_clock::now().time_since_epoch()).count();
+  string simd = vm["simd"].as<string>();
 
-    seed = (int)millis;
-  }
-
-  cout << "world:   " << world      << endl;
-  cout << "wpar:    " << wPar       << endl;
-  cout << "width:   " << width      << endl;
-  cout << "height:  " << height     << endl;
-  cout << "fow:     " << fow        << endl;
-  cout << "qteps:   " << qtEps      << endl;
+  Game::writeSpec(cout, spec);
   cout << "delay:   " << delay      << endl;
-  cout << "seed:    " << seed       << endl;
-  cout << "rplayer: " << redPlayer  << endl;
-  cout << "bplayer: " << bluePlayer << endl;
-  cout << "rpar:    " << rPar       << endl;
-  cout << "bpar:    " << bPar       << endl;
-  cout << "steps:   " << steps      << endl;
+
+  // results don't depend on the level, only speed
+  RangeKernels::select(RangeKernels::levelFromString(simd));
+  cout << "simd:    " << RangeKernels::levelToString(RangeKernels::getLevel()) << endl;
 
   if (gfxScale <= 0) {
     cout << "gfx: "      << "none" << endl;
@@ -230,45 +168,50 @@ int main(int argc, char *argv[])
     cout << "gfx: "      << "scale " << gfxScale << endl;
   }
 
-  // set up world
+  // set up world and players, run game
 
-  world = newWorld(worldType);
+  if (replay) {
 
-  // set up players
+    int seek = vm["seek"].as<int>();
+    cout << "replay:  " << vm["replay"].as<string>() << " (" << replay->getEndFrame()
+         << " frames, keyframes every " << replay->getKeyframeInterval() << ")" << endl;
 
-  Player *pRed  = newPlayer(redPlayer,  world, 0, "RED_"  + redPlayer,  qtEps, rPar, seed);
-  Player *pBlue = newPlayer(bluePlayer, world, 1, "BLUE_" + bluePlayer, qtEps, bPar, seed);
+    if (seek > 0) {
+      Timer start(Timer::WALLCLOCK);
+      replay->seek(seek);
+      Timer end(Timer::WALLCLOCK);
+      cout << "seek:    frame " << game->getWorld().getFrameCount() << " in "
+           << static_cast<double>(end.diff(start)) / 1000.0 << " ms" << endl;
+    }
 
-  // wire up components
+  } else {
 
-  world->setup(width, height, fow, seed, pRed, pBlue, qtEps, wPar);
+    game = new Game(spec);
 
-  // run game
-  
-  maxSteps = 100'000;
-
-  if (steps != -1) {
-    maxSteps = min(steps, maxSteps);
+    if (vm.count("record")) {
+      cout << "record:  " << vm["record"].as<string>() << endl;
+      game->record(vm["record"].as<string>(), vm["keyframes"].as<int>());
+    }
   }
   
   if (gfxScale != 0) {
     
     glutInit(&argc, argv);
-    glutInitWindowSize((int)ceil(width * gfxScale), (int)ceil(height * gfxScale));
+    glutInitWindowSize((int)ceil(spec.width * gfxScale), (int)ceil(spec.height * gfxScale));
     glutInitDisplayMode(GLUT_DOUBLE);
     glutCreateWindow("CSIM - Combat Simulator");
     
     glutDisplayFunc(onDisplay);
     glutTimerFunc(1, timerFunction, 0);
 
-    gfx = new Gfx(world);
-    world->setListener(gfx);
+    gfx = new Gfx(&game->getWorld());
+    game->getWorld().setListener(gfx);
 
     glutMainLoop();
     return 0;
   }
 
-  // no gfx
+  // no gfx
 
   for (;;) {
     execStep();